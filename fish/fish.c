@@ -8,6 +8,9 @@
 uint8_t *vmem_base_addr;
 uint8_t *mp1_set_video_mode (void);
 void add_frames(uint8_t *, uint8_t *, int32_t);
+struct frame_file;
+void open_frame(struct frame_file *frame, uint8_t *fname);
+int32_t read_frame(struct frame_file *frame, uint8_t *c);
 void ece391_memset(void* memory, char c, int n);
 int32_t ece391_memcpy(void* dest, const void* src, int32_t n);
 
@@ -76,11 +79,45 @@ int main(void)
     return 0;
 }
 
+/* A frame file, either mapped with ece391_mmap or read one byte at a time */
+struct frame_file {
+    int32_t fd;
+    uint8_t *data;      /* NULL if the file could not be mapped */
+    int32_t length;
+    int32_t pos;
+};
+
+void
+open_frame(struct frame_file *frame, uint8_t *fname)
+{
+    if( (frame->fd = ece391_open(fname)) < 0 ) {
+        ece391_halt(-1);
+    }
+    frame->pos = 0;
+    if( (frame->length = ece391_mmap(frame->fd, &frame->data)) < 0 ) {
+        frame->data = NULL;
+    }
+}
+
+/* Returns the number of bytes read into *c (0 at end of file) */
+int32_t
+read_frame(struct frame_file *frame, uint8_t *c)
+{
+    if(frame->data == NULL) {
+        return ece391_read(frame->fd, c, 1);
+    }
+    if(frame->pos >= frame->length) {
+        return 0;
+    }
+    *c = frame->data[frame->pos++];
+    return 1;
+}
+
 void
 add_frames(uint8_t *f0, uint8_t *f1, int32_t rtc_fd)
 {
     int32_t row, col, offset = 40, eof0 = 0, eof1 = 0, num_bytes;
-    int32_t fd0, fd1;
+    struct frame_file frame0, frame1;
     struct mp1_blink_struct blink_struct;
     uint8_t c0 = '0', c1 = '0';
 
@@ -89,19 +126,15 @@ add_frames(uint8_t *f0, uint8_t *f1, int32_t rtc_fd)
 
     row = 0;
 
-    if( (fd0 = ece391_open(f0)) < 0 ) {
-        ece391_halt(-1);
-    }
-    if( (fd1 = ece391_open(f1)) < 0 ) {
-        ece391_halt(-1);
-    }
+    open_frame(&frame0, f0);
+    open_frame(&frame1, f1);
 
     while(eof0 == 0 || eof1 == 0) {
         col = 0;
         while(1) {
 
             if(c0 != '\n') {
-                num_bytes = ece391_read(fd0, &c0, 1);
+                num_bytes = read_frame(&frame0, &c0);
                 if(num_bytes == 0) {
                     c0 = '\n';
                     eof0 = 1;
@@ -109,7 +142,7 @@ add_frames(uint8_t *f0, uint8_t *f1, int32_t rtc_fd)
             }
 
             if(c1 != '\n') {
-                num_bytes = ece391_read(fd1, &c1, 1);
+                num_bytes = read_frame(&frame1, &c1);
                 if(num_bytes == 0) {
                     c1 = '\n';
                     eof1 = 1;
@@ -132,14 +165,14 @@ add_frames(uint8_t *f0, uint8_t *f1, int32_t rtc_fd)
 
         if(eof0) {
             c0 = '\n';
-            ece391_close(fd0);
+            ece391_close(frame0.fd);
         } else {
             c0 = '0';
         }
 
         if(eof1) {
             c1 = '\n';
-            ece391_close(fd1);
+            ece391_close(frame1.fd);
         } else {
             c1 = '0';
         }
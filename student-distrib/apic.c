@@ -0,0 +1,76 @@
+#include "apic.h"
+#include "lib.h"
+#include "paging.h"
+
+static volatile uint32_t * apic_regs; // NULL until apic_init finds an APIC
+
+/* apic_write
+ *    INPUT: reg - register offset
+ *           value - value to store
+ * FUNCTION: writes a local APIC register
+ */
+static void apic_write(uint32_t reg, uint32_t value)
+{
+	apic_regs[reg / sizeof(uint32_t)] = value;
+}
+
+/* apic_read
+ *    INPUT: reg - register offset
+ * FUNCTION: reads a local APIC register
+ */
+static uint32_t apic_read(uint32_t reg)
+{
+	return apic_regs[reg / sizeof(uint32_t)];
+}
+
+/* apic_init
+ *    INPUT: none
+ * FUNCTION: checks cpuid for a local APIC, maps its registers uncached and software enables it.
+ *           The 8259 keeps delivering the other irqs through LINT0. The timer is left masked
+ *           until apic_timer_oneshot. Returns 0, or -1 if there is no APIC
+ */
+int32_t apic_init(void)
+{
+	uint32_t low, high;
+	if(!(cpuid_edx(CPUID_FEATURES) & CPUID_EDX_APIC))
+		return -1;
+
+	rdmsr(IA32_APIC_BASE_MSR, low, high);
+	low |= APIC_BASE_ENABLE;
+	wrmsr(IA32_APIC_BASE_MSR, low, high);
+	apic_regs = (volatile uint32_t *)paging_map_mmio(low & APIC_BASE_MASK);
+
+	apic_write(APIC_REG_TPR, 0); // accept every priority
+	apic_write(APIC_REG_SVR, APIC_SVR_ENABLE | APIC_SPURIOUS_IDT);
+	apic_write(APIC_REG_TIMER_DIVIDE, APIC_TIMER_DIVIDE_16);
+	apic_write(APIC_REG_LVT_TIMER, APIC_LVT_MASKED | APIC_TIMER_IDT);
+	return 0;
+}
+
+/* apic_timer_oneshot
+ *    INPUT: count - timer units until the interrupt
+ * FUNCTION: (re)starts the timer in one-shot mode, any countdown in progress is replaced
+ */
+void apic_timer_oneshot(uint32_t count)
+{
+	apic_write(APIC_REG_LVT_TIMER, APIC_TIMER_IDT); // one-shot mode, unmasked
+	apic_write(APIC_REG_TIMER_INITIAL, count);
+}
+
+/* apic_timer_current
+ *    INPUT: none
+ * FUNCTION: returns the timer's current count
+ */
+uint32_t apic_timer_current(void)
+{
+	return apic_read(APIC_REG_TIMER_CURRENT);
+}
+
+/* apic_eoi
+ *    INPUT: none
+ * FUNCTION: signals end of interrupt to the local APIC
+ */
+void apic_eoi(void)
+{
+	apic_write(APIC_REG_EOI, 0);
+}
@@ -0,0 +1,39 @@
+/* apic.h - Local APIC timer
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _apic_H
+#define _apic_H
+
+#include "types.h"
+
+#define CPUID_EDX_APIC (1 << 9)
+#define IA32_APIC_BASE_MSR 0x1B
+#define APIC_BASE_ENABLE (1 << 11) // global enable bit of IA32_APIC_BASE
+#define APIC_BASE_MASK 0xFFFFF000
+
+// register offsets from the APIC base
+#define APIC_REG_TPR 0x080
+#define APIC_REG_EOI 0x0B0
+#define APIC_REG_SVR 0x0F0
+#define APIC_REG_LVT_TIMER 0x320
+#define APIC_REG_TIMER_INITIAL 0x380
+#define APIC_REG_TIMER_CURRENT 0x390
+#define APIC_REG_TIMER_DIVIDE 0x3E0
+
+#define APIC_SVR_ENABLE 0x100 // software enable bit of the spurious vector register
+#define APIC_LVT_MASKED 0x10000
+#define APIC_TIMER_DIVIDE_16 0x3
+#define APIC_TIMER_IDT 0x40 // above the 8259 vectors
+#define APIC_SPURIOUS_IDT 0xFF
+
+/* Map and enable the local APIC with its timer masked, returns -1 if the cpu has none */
+int32_t apic_init(void);
+/* Start a one-shot countdown of 'count' timer units, interrupting at APIC_TIMER_IDT */
+void apic_timer_oneshot(uint32_t count);
+/* Timer units left in the running countdown, 0 once it expired */
+uint32_t apic_timer_current(void);
+/* Acknowledge the interrupt being serviced */
+void apic_eoi(void);
+
+#endif /* _apic_H */
@@ -0,0 +1,210 @@
+#include "pipe.h"
+#include "../syscalls.h"
+
+static pipe_t pipes[MAX_PIPES];
+
+/* pipe_lookup
+ *    INPUT: fd - pipe file descriptor of the current process
+ * FUNCTION: returns the pipe behind 'fd'
+ */
+static pipe_t * pipe_lookup(int32_t fd)
+{
+	return get_group_ptr()->fd[fd].pipe;
+}
+
+/* pipe_put
+ *    INPUT: pipe - pipe that lost its last descriptor on one end
+ * FUNCTION: frees the buffer and the slot once neither end is open
+ */
+static void pipe_put(pipe_t * pipe)
+{
+	if(pipe->readers != 0 || pipe->writers != 0)
+		return;
+	frame_free((uint32_t)pipe->buffer);
+	pipe->buffer = NULL;
+	pipe->in_use = 0;
+}
+
+/* pipe_create
+ *    INPUT: none
+ * FUNCTION: takes a free pipe slot and a frame for its buffer, the caller owns one reader and one
+ *           writer. Returns NULL if there is no free slot or frame
+ */
+pipe_t * pipe_create(void)
+{
+	pipe_t * pipe;
+	uint32_t i, flags;
+
+	cli_and_save(flags);
+	for(i = 0; i < MAX_PIPES && pipes[i].in_use; i++);
+	if(i == MAX_PIPES) {
+		restore_flags(flags);
+		return NULL;
+	}
+	pipe = &pipes[i];
+	pipe->buffer = (uint8_t*)frame_alloc();
+	if(pipe->buffer == NULL) {
+		restore_flags(flags);
+		return NULL;
+	}
+	pipe->in_use = 1;
+	pipe->head = 0;
+	pipe->count = 0;
+	pipe->readers = 1;
+	pipe->writers = 1;
+	wait_queue_init(&pipe->read_wait);
+	wait_queue_init(&pipe->write_wait);
+	restore_flags(flags);
+	return pipe;
+}
+
+/* pipe_get
+ *    INPUT: pipe - open pipe
+ *           end - PIPE_READ_END or PIPE_WRITE_END
+ * FUNCTION: counts one more descriptor on 'end'
+ */
+void pipe_get(pipe_t * pipe, uint32_t end)
+{
+	uint32_t flags;
+	cli_and_save(flags);
+	if(end == PIPE_READ_END)
+		pipe->readers++;
+	else
+		pipe->writers++;
+	restore_flags(flags);
+}
+
+/* pipe_open
+ *    INPUT: see sys_open in syscalls.c
+ * FUNCTION: pipes have no name, they are only made by sys_pipe
+ */
+int32_t pipe_open(const uint8_t* filename)
+{
+	return -1;
+}
+
+/* pipe_read
+ *    INPUT: see sys_read in syscalls.c
+ * FUNCTION: sleeps until the pipe holds data (or has no writers left), then copies out as much
+ *           as is there, up to nbytes. Returns the bytes read, 0 at end of file, or -1 if the
+ *           process ends while the caller sleeps
+ */
+int32_t pipe_read(int32_t fd, void* buf, int32_t nbytes)
+{
+	pipe_t * pipe = pipe_lookup(fd);
+	uint32_t n, first, flags;
+
+	if(buf == NULL || nbytes < 0)
+		return -1;
+	if(nbytes == 0)
+		return 0;
+
+	cli_and_save(flags);
+	while(pipe->count == 0 && pipe->writers != 0) {
+		if(get_group_ptr()->exiting) {
+			restore_flags(flags);
+			return -1; // the process ended, the thread halts on its way out
+		}
+		sleep_on(&pipe->read_wait);
+	}
+	n = ((uint32_t)nbytes < pipe->count) ? (uint32_t)nbytes : pipe->count;
+	first = (n < PIPE_SIZE - pipe->head) ? n : PIPE_SIZE - pipe->head; // bytes before the wrap
+	memcpy(buf, pipe->buffer + pipe->head, first);
+	memcpy((uint8_t*)buf + first, pipe->buffer, n - first);
+	pipe->head = (pipe->head + n) % PIPE_SIZE;
+	pipe->count -= n;
+	if(n != 0)
+		wake_up(&pipe->write_wait);
+	restore_flags(flags);
+	return n;
+}
+
+/* pipe_write
+ *    INPUT: see sys_write in syscalls.c
+ * FUNCTION: copies all nbytes into the pipe, sleeping whenever it is full. Returns nbytes, or -1
+ *           if there are no readers or the process ends (any part already written stays in the pipe)
+ */
+int32_t pipe_write(int32_t fd, const void* buf, int32_t nbytes)
+{
+	pipe_t * pipe = pipe_lookup(fd);
+	uint32_t done = 0, n, tail, first, flags;
+
+	if(buf == NULL || nbytes < 0)
+		return -1;
+
+	cli_and_save(flags);
+	while(done < (uint32_t)nbytes) {
+		while(pipe->count == PIPE_SIZE && pipe->readers != 0 && !get_group_ptr()->exiting)
+			sleep_on(&pipe->write_wait);
+		if(pipe->readers == 0 || get_group_ptr()->exiting) {
+			restore_flags(flags);
+			return -1;
+		}
+		n = PIPE_SIZE - pipe->count;
+		if(n > nbytes - done)
+			n = nbytes - done;
+		tail = (pipe->head + pipe->count) % PIPE_SIZE;
+		first = (n < PIPE_SIZE - tail) ? n : PIPE_SIZE - tail; // bytes before the wrap
+		memcpy(pipe->buffer + tail, (const uint8_t*)buf + done, first);
+		memcpy(pipe->buffer, (const uint8_t*)buf + done + first, n - first);
+		pipe->count += n;
+		done += n;
+		wake_up(&pipe->read_wait);
+	}
+	restore_flags(flags);
+	return nbytes;
+}
+
+/* pipe_bad_read
+ *    INPUT: see sys_read in syscalls.c
+ * FUNCTION: the write end can't be read
+ */
+int32_t pipe_bad_read(int32_t fd, void* buf, int32_t nbytes)
+{
+	return -1;
+}
+
+/* pipe_bad_write
+ *    INPUT: see sys_write in syscalls.c
+ * FUNCTION: the read end can't be written
+ */
+int32_t pipe_bad_write(int32_t fd, const void* buf, int32_t nbytes)
+{
+	return -1;
+}
+
+/* pipe_close_read
+ *    INPUT: see sys_close in syscalls.c
+ * FUNCTION: drops a reader, writers blocked on a full pipe wake up and fail once none are left
+ */
+int32_t pipe_close_read(int32_t fd)
+{
+	pipe_t * pipe = pipe_lookup(fd);
+	uint32_t flags;
+
+	cli_and_save(flags);
+	pipe->readers--;
+	if(pipe->readers == 0)
+		wake_up(&pipe->write_wait);
+	pipe_put(pipe);
+	restore_flags(flags);
+	return 0;
+}
+
+/* pipe_close_write
+ *    INPUT: see sys_close in syscalls.c
+ * FUNCTION: drops a writer, readers blocked on an empty pipe wake up to end of file once none are left
+ */
+int32_t pipe_close_write(int32_t fd)
+{
+	pipe_t * pipe = pipe_lookup(fd);
+	uint32_t flags;
+
+	cli_and_save(flags);
+	pipe->writers--;
+	if(pipe->writers == 0)
+		wake_up(&pipe->read_wait);
+	pipe_put(pipe);
+	restore_flags(flags);
+	return 0;
+}
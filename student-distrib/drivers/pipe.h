@@ -0,0 +1,54 @@
+/* pipe.h - Defines kernel pipes
+ */
+
+#ifndef _PIPE_H
+#define _PIPE_H
+
+#include "../types.h"
+#include "../sched.h"
+
+#define MAX_PIPES 16
+#define PIPE_SIZE 4096 // ring buffer bytes, one frame
+#define PIPE_READ_END 0
+#define PIPE_WRITE_END 1
+
+/*
+pipe: (one per pipe, shared by every descriptor of either end)
+1. in_use : slot holds a pipe
+2. buffer : PIPE_SIZE byte ring buffer in an allocator frame
+3. head : index of the oldest byte
+4. count : bytes in the buffer
+5. readers / writers : open descriptors of each end, reads see end of file once writers is 0
+   and writes fail once readers is 0
+6. read_wait : readers sleeping on an empty pipe
+7. write_wait : writers sleeping on a full pipe
+*/
+typedef struct pipe {
+	uint32_t in_use;
+	uint8_t * buffer;
+	uint32_t head;
+	uint32_t count;
+	uint32_t readers;
+	uint32_t writers;
+	wait_queue_t read_wait;
+	wait_queue_t write_wait;
+} pipe_t;
+
+/* create a pipe with one descriptor on each end, NULL if there is no slot or memory */
+pipe_t * pipe_create(void);
+/* another descriptor now refers to 'end' of 'pipe' (inherited by a child) */
+void pipe_get(pipe_t * pipe, uint32_t end);
+/* open */
+int32_t pipe_open(const uint8_t* filename);
+/* read, blocks while the pipe is empty and has writers */
+int32_t pipe_read(int32_t fd, void* buf, int32_t nbytes);
+/* write, blocks while the pipe is full and has readers */
+int32_t pipe_write(int32_t fd, const void* buf, int32_t nbytes);
+/* read and write for the end that does not support them */
+int32_t pipe_bad_read(int32_t fd, void* buf, int32_t nbytes);
+int32_t pipe_bad_write(int32_t fd, const void* buf, int32_t nbytes);
+/* close either end */
+int32_t pipe_close_read(int32_t fd);
+int32_t pipe_close_write(int32_t fd);
+
+#endif /* _PIPE_H */
@@ -1,104 +1,178 @@
 #include "rtc.h"
 
+/* Every process has its own view of the rtc: the chip interrupts at RTC_MAX_FREQ
+ * and each open descriptor counts hardware ticks down to its own frequency, so a
+ * program changing its rate does not change anyone else's. */
+static rtc_virt_t rtc_virt[MAX_NUM_PROCESSES][TOTAL_NUMBER_OF_FILE_DESCRIPTORS];
+/* descriptors that are open, the interrupt only walks these */
+static rtc_virt_t * rtc_active[MAX_NUM_PROCESSES * TOTAL_NUMBER_OF_FILE_DESCRIPTORS];
+static uint32_t rtc_num_active;
+
+/* rtc_lookup
+ *    INPUT: fd - rtc file descriptor of the current process
+ * FUNCTION: returns the virtual rtc of 'fd', NULL if it is not an open rtc
+ */
+static rtc_virt_t * rtc_lookup(int32_t fd)
+{
+	rtc_virt_t * v;
+	if(fd < 0 || fd >= TOTAL_NUMBER_OF_FILE_DESCRIPTORS)
+		return NULL;
+	v = &rtc_virt[get_group_ptr()->p_id][fd];
+	return v->in_use ? v : NULL;
+}
+
+/* rtc_init
+ *    INPUT: none
+ * FUNCTION: turns on periodic interrupts at RTC_MAX_FREQ. The irq line is only unmasked while
+ *           some descriptor is open, so an unused rtc costs nothing
+ */
+void rtc_init(void)
+{
+	cli();			// disable interrupts
+	outb(SELECT_REGB,RTC_PORT1);		// select register B, and disable NMI
+	char prev = inb(RTC_PORT2);	// read the current value of register B
+	outb(SELECT_REGB,RTC_PORT1);		// set the index again (a read will reset the index to register D)
+	outb(prev | SELECTBIT6,RTC_PORT2);	// write the previous value ORed with 0x40. This turns on bit 6 of register B
+
+	outb(REGA, RTC_PORT1);	// disable non-maskable interrupts
+	unsigned char rate = inb(RTC_PORT2);	// get current value of register A
+	outb(REGA, RTC_PORT1);	// set index to regsiter A
+	outb((rate & LOW_4_MASK) | FREQ_1024, RTC_PORT2);	// fixed rate, virtual rtcs divide it down
+	sti();
+
+	rtc_num_active = 0;
+	rtc_hw_ticks = 0;
+}
 
 /* process_rtc
  *    INPUT: none
- * FUNCTION: process the rtc
+ * FUNCTION: process the rtc, counts down every open virtual rtc and wakes its readers when it expires
  */
 void process_rtc()
 {
+	uint32_t i;
+	rtc_virt_t * v;
+
 	outb(REGC,RTC_PORT1);	// select register C
 	inb(RTC_PORT2);		// just throw away contents
-	rtc_interrupt_occurred = 1;	// interrupt occured for rtc_read()
+	rtc_hw_ticks++;
+	for(i = 0; i < rtc_num_active; i++) {
+		v = rtc_active[i];
+		if(--v->countdown == 0) {
+			v->countdown = v->reload;
+			v->fired = 1;	// interrupt occured for rtc_read()
+			wake_up(&v->wait);
+		}
+	}
 }
 
 /* open_rtc
  *    INPUT: see sys_open in syscall.c
- * FUNCTION: opens RTC device
+ * FUNCTION: opens RTC device, per descriptor state is set up by open_rtc_fd
  */
 int32_t open_rtc(const uint8_t* filename)
 {
-	cli();			// disable interrupts
-	outb(SELECT_REGB,RTC_PORT1);		// select register B, and disable NMI
-	char prev = inb(RTC_PORT2);	// read the current value of register B
-	outb(SELECT_REGB,RTC_PORT1);		// set the index again (a read will reset the index to register D)
-	outb(prev | SELECTBIT6,RTC_PORT2);	// write the previous value ORed with 0x40. This turns on bit 6 of register B
-	sti();
+	return 0;
+}
 
-	int frequency = 2; // documentation specifies starting frequency of 2 Hz
-	write_rtc(0, &frequency, 0); // 0 since fd and nbytes dont matter
+/* open_rtc_fd
+ *    INPUT: fd - descriptor sys_open is handing out for the rtc
+ * FUNCTION: starts a virtual rtc at RTC_DEFAULT_FREQ for 'fd' and unmasks the rtc irq if it is the first
+ */
+int32_t open_rtc_fd(int32_t fd)
+{
+	rtc_virt_t * v;
+	uint32_t flags;
+	if(fd < 0 || fd >= TOTAL_NUMBER_OF_FILE_DESCRIPTORS)
+		return -1;
+	v = &rtc_virt[get_group_ptr()->p_id][fd];
 
+	cli_and_save(flags);
+	if(!v->in_use) {
+		v->in_use = 1;
+		v->reload = RTC_MAX_FREQ / RTC_DEFAULT_FREQ;
+		v->countdown = v->reload;
+		v->fired = 0;
+		wait_queue_init(&v->wait);
+		rtc_active[rtc_num_active++] = v;
+		if(rtc_num_active == 1) {
+			outb(REGC,RTC_PORT1);	// a tick left pending while masked would stop the next one
+			inb(RTC_PORT2);
+			enable_irq(RTC_IRQ);
+		}
+	}
+	restore_flags(flags);
 	return 0;
 }
 
 /* read_rtc
  *    INPUT: see sys_read in syscalls.c
- * FUNCTION: returns when rtc tick/interrupt occurred
+ * FUNCTION: returns when this descriptor's next virtual tick occurred, sleeping until then
  */
 int32_t read_rtc(int32_t fd, void* buf, int32_t nbytes)
 {
-	cli();
-	rtc_interrupt_occurred = 0;
-	sti();
-	while(!rtc_interrupt_occurred);
+	rtc_virt_t * v = rtc_lookup(fd);
+	uint32_t flags;
+	if(v == NULL)
+		return -1;
+
+	cli_and_save(flags);
+	v->fired = 0;
+	while(!v->fired) {
+		if(get_group_ptr()->exiting) {
+			restore_flags(flags);
+			return -1; // the process ended, the thread halts on its way out
+		}
+		sleep_on(&v->wait);
+	}
+	restore_flags(flags);
 	return 0;
 }
 
 /* write_rtc
  *    INPUT: see sys_write in syscalls.c
- * FUNCTION: writes coor. frequency to rtc if power of 2 (up to 1024)
+ * FUNCTION: sets this descriptor's frequency if it is a power of 2 (2 up to 1024),
+ *           the hardware rate is not touched
  */
 int32_t write_rtc(int32_t fd, const void* buf, int32_t nbytes)
 {
-	int rate;
-	switch(*(int*)buf) {
-		case(2):
-			rate = FREQ_2;
-			break;
-		case(4):
-			rate = FREQ_4;
-			break;
-		case(8):
-			rate = FREQ_8;
-			break;
-		case(16):
-			rate = FREQ_16;
-			break;
-		case(32):
-			rate = FREQ_32;
-			break;
-		case(64):
-			rate = FREQ_64;
-			break;
-		case(128):
-			rate = FREQ_128;
-			break;
-		case(256):
-			rate = FREQ_256;
-			break;
-		case(512):
-			rate = FREQ_512;
-			break;
-		case(1024):
-			rate = FREQ_1024;
-			break;
-		default:
-			return -1;
-	}
-	cli();
-	outb(REGA, RTC_PORT1);	// disable non-maskable interrupts
-	unsigned char prev = inb(RTC_PORT2);	// get current value of register A
-	outb(REGA, RTC_PORT1);	// set index to regsiter A
-	outb((prev & LOW_4_MASK) | rate, RTC_PORT2);	// modify rate of RTC
-	sti();
+	rtc_virt_t * v = rtc_lookup(fd);
+	int frequency;
+	uint32_t flags;
+	if(v == NULL || buf == NULL)
+		return -1;
+	frequency = *(int*)buf;
+	if(frequency < RTC_DEFAULT_FREQ || frequency > RTC_MAX_FREQ || (frequency & (frequency - 1)))
+		return -1;
+
+	cli_and_save(flags);
+	v->reload = RTC_MAX_FREQ / frequency;
+	v->countdown = v->reload;
+	restore_flags(flags);
 	return 0;
 }
 
 /* close_rtc
  *    INPUT: see sys_close in syscalls.c
- * FUNCTION: blank handler for close rtc
+ * FUNCTION: drops the descriptor's virtual rtc, masks the rtc irq when the last one closes
  */
 int32_t close_rtc(int32_t fd)
 {
+	rtc_virt_t * v = rtc_lookup(fd);
+	uint32_t i, flags;
+	if(v == NULL)
+		return 0;
+
+	cli_and_save(flags);
+	v->in_use = 0;
+	for(i = 0; i < rtc_num_active; i++) {
+		if(rtc_active[i] == v) {
+			rtc_active[i] = rtc_active[--rtc_num_active];
+			break;
+		}
+	}
+	if(rtc_num_active == 0)
+		disable_irq(RTC_IRQ);
+	restore_flags(flags);
 	return 0;
 }
@@ -7,6 +7,7 @@
 #include "../types.h"
 #include "../lib.h"
 #include "../idt.h"
+#include "../sched.h"
 
 #define RTC_PORT1 0x70
 #define RTC_PORT2 0x71
@@ -26,11 +27,34 @@
 #define FREQ_256 8
 #define FREQ_512 7
 #define FREQ_1024 6
+#define RTC_MAX_FREQ 1024 // the hardware always runs at this rate
+#define RTC_DEFAULT_FREQ 2 // documentation specifies starting frequency of 2 Hz
 
-volatile int rtc_interrupt_occurred;
+/*
+rtc_virt: (one per open rtc file descriptor)
+1. in_use : descriptor is open
+2. reload : hardware ticks per virtual tick (RTC_MAX_FREQ / requested frequency)
+3. countdown : hardware ticks left until the next virtual tick
+4. fired : set by the interrupt at each virtual tick, read_rtc waits for it
+5. wait : tasks sleeping in read_rtc on this descriptor
+*/
+typedef struct rtc_virt {
+	uint32_t in_use;
+	uint32_t reload;
+	uint32_t countdown;
+	volatile uint32_t fired;
+	wait_queue_t wait;
+} rtc_virt_t;
 
+/* hardware ticks handled (the irq is masked while no rtc is open) */
+volatile uint32_t rtc_hw_ticks;
+
+/* set the hardware to RTC_MAX_FREQ, the interrupt stays masked until an rtc is opened */
+void rtc_init(void);
 /* handler for ticks */
 void process_rtc();
+/* give descriptor 'fd' of the current process its own virtual rtc */
+int32_t open_rtc_fd(int32_t fd);
 /* open */
 int32_t open_rtc(const uint8_t* filename);
 /* read */
@@ -40,6 +64,4 @@ int32_t write_rtc(int32_t fd, const void* buf, int32_t nbytes);
 /* close */
 int32_t close_rtc(int32_t fd);
 
-int CP2_RTC_FLAG;
-
 #endif /* _RTC_H */
@@ -17,6 +17,7 @@ char shift_keyscan []={' ','!','@','#','$','%','^','&','*','(',')','_','+',' ','
  */
 void init_terminal(void)
 {
+    int i;
     shift = 0;
     capslock = 0;
     ctrl_l = 0;
@@ -27,6 +28,10 @@ void init_terminal(void)
     entered[0] = 0;
     entered[1] = 0;
     entered[2] = 0;
+    for(i = 0; i < 3; i++) {
+        wait_queue_init(&stdin_wait[i]);
+        read_want[i] = BUFFER_W;
+    }
     current_terminal = 0;
     buff_to_top();
 }
@@ -44,8 +49,10 @@ void process_key(unsigned char scan_code)
             putc_input('\n');
             term_buffer[current_terminal][term_loc[current_terminal]] = '\n';
             entered[current_terminal] = 1;
+            enter_tsc[current_terminal] = rdtsc();
             term_loc[current_terminal] = 0;
             update_cursor();
+            wake_up(&stdin_wait[current_terminal]);
             break;
         case DELETE:
             if(term_loc[current_terminal] > 0){
@@ -95,6 +102,8 @@ void process_key(unsigned char scan_code)
                 term_buffer[current_terminal][term_loc[current_terminal]] = ' ';
                 term_loc[current_terminal]++;
                 update_cursor();
+                if(term_loc[current_terminal] >= read_want[current_terminal])
+                    wake_up(&stdin_wait[current_terminal]);
             }
             break;
         default:
@@ -102,6 +111,10 @@ void process_key(unsigned char scan_code)
                 if(ctrl_l == 1){ // don't print if control is pressed
                     if(scan_code == CHAR_L)
                         buff_to_top();
+                    else if(scan_code == CHAR_T)
+                        print_cpu_status();
+                    else if(scan_code == CHAR_P)
+                        toggle_sched_policy();
                     break;
                 } else if(alt_l == 1 && 59 <= scan_code && scan_code <= 61) { // check for F1 - F3 to switch terminals
                     
@@ -119,6 +132,7 @@ void process_key(unsigned char scan_code)
                             break;
                     }
                     swap_terminal_mapping(current_terminal + 1);
+                    kinfo_set_screen(current_terminal);
                     update_cursor();
                     break;
                     // ---         --- //
@@ -141,6 +155,8 @@ void process_key(unsigned char scan_code)
                 term_buffer[current_terminal][term_loc[current_terminal]] = key;
                 term_loc[current_terminal]++;
                 update_cursor();
+                if(term_loc[current_terminal] >= read_want[current_terminal])
+                    wake_up(&stdin_wait[current_terminal]);
         }
     }
 }
@@ -163,6 +179,77 @@ void buff_to_top(void)
     update_cursor();
 }
 
+/* puts_input
+ *    INPUT: str - string to print
+ * FUNCTION: prints a string on the terminal being shown (see putc_input)
+ */
+static void puts_input(const int8_t* str)
+{
+    while(*str != '\0')
+        putc_input(*str++);
+}
+
+/* print_cpu_status
+ *    INPUT: None
+ * FUNCTION: prints one line per process with the PIT ticks it has been charged, so the share of
+ *           cpu each task gets can be checked (a shell waiting for input should not gain any)
+ *           triggered with: `Ctrl` - `t` keypress combination
+ */
+void print_cpu_status(void)
+{
+    int8_t num[11];
+    int pid;
+    PCB * pcb;
+
+    putc_input('\n');
+    puts_input(itoa(timer_ticks, num, 10));
+    puts_input(" ticks since boot in ");
+    puts_input(itoa(timer_interrupts, num, 10));
+    puts_input(" timer interrupts, idle ");
+    puts_input(itoa(sched_idle_ticks, num, 10));
+    if(timer_ticks > 0) {
+        puts_input(" (");
+        puts_input(itoa(sched_idle_ticks * 100 / timer_ticks, num, 10));
+        puts_input("%)");
+    }
+    for(pid = 0; pid < MAX_NUM_PROCESSES; pid++) {
+        pcb = get_pcb_by_pid(pid);
+        if(pcb == NULL || pcb->state == TASK_UNUSED)
+            continue;
+        puts_input("\npid ");
+        puts_input(itoa(pid, num, 10));
+        puts_input(pcb->state == TASK_RUNNABLE ? " run " : (pcb->state == TASK_BLOCKED ? " wait " : " exit "));
+        puts_input(itoa(pcb->run_ticks, num, 10));
+    }
+    puts_input("\nenter to read (cycles): last ");
+    puts_input(itoa(enter_latency_last, num, 10));
+    puts_input(" avg ");
+    puts_input(itoa(enter_latency_avg, num, 10));
+    puts_input(" max ");
+    puts_input(itoa(enter_latency_max, num, 10));
+    puts_input(sched_policy == SCHED_POLICY_MLFQ ? " (mlfq)" : " (round robin)");
+    putc_input('\n');
+    update_cursor();
+}
+
+/* toggle_sched_policy
+ *    INPUT: None
+ * FUNCTION: switches between the round robin and mlfq policies and restarts the enter latency
+ *           statistics, so the two can be compared under the same load
+ *           triggered with: `Ctrl` - `p` keypress combination
+ */
+void toggle_sched_policy(void)
+{
+    sched_set_policy(sched_policy == SCHED_POLICY_MLFQ ? SCHED_POLICY_RR : SCHED_POLICY_MLFQ);
+    enter_latency_last = 0;
+    enter_latency_avg = 0;
+    enter_latency_max = 0;
+    putc_input('\n');
+    puts_input(sched_policy == SCHED_POLICY_MLFQ ? "scheduler: mlfq" : "scheduler: round robin");
+    putc_input('\n');
+    update_cursor();
+}
+
 /* stdout_read
  *    INPUT: see sys_read in syscalls.c
  * FUNCTION: blank handler for stdout read
@@ -179,15 +266,39 @@ int32_t stdout_read (int32_t fd, void* buf, int32_t nbytes)
 int32_t stdin_read (int32_t fd, void* buf, int32_t nbytes)
 {
     int parent_terminal = process_term();
-    if(buf == NULL)
-        return -1;
+    if(buf == NULL || !user_buffer_writable(buf, BUFFER_W))
+        return -1; // the whole line buffer is written, whatever nbytes says
     int i;
+    int slept = 0;
+    uint32_t flags, latency;
     // clear terminal buffer
     for(i = 0; i < BUFFER_W; i++){
         term_loc[parent_terminal] = 0;
         term_buffer[parent_terminal][i] = '\0';
     }
-    while(!entered[parent_terminal] && term_loc[parent_terminal] < 128 && term_loc[parent_terminal] < nbytes);
+    // sleep until process_key sees enter or the request is filled, checking with interrupts off so no wake up is lost
+    cli_and_save(flags);
+    while(!entered[parent_terminal] && term_loc[parent_terminal] < BUFFER_W && term_loc[parent_terminal] < nbytes) {
+        if(get_group_ptr()->exiting) {
+            // the process ended, the thread halts on its way out
+            read_want[parent_terminal] = BUFFER_W;
+            restore_flags(flags);
+            return -1;
+        }
+        read_want[parent_terminal] = (nbytes < BUFFER_W) ? nbytes : BUFFER_W;
+        sleep_on(&stdin_wait[parent_terminal]);
+        slept = 1;
+    }
+    read_want[parent_terminal] = BUFFER_W;
+    if(slept && entered[parent_terminal]) {
+        // how long the woken reader waited for the cpu, to compare scheduling policies under load
+        latency = rdtsc() - enter_tsc[parent_terminal];
+        enter_latency_last = latency;
+        enter_latency_avg = enter_latency_avg - (enter_latency_avg >> 3) + (latency >> 3);
+        if(latency > enter_latency_max)
+            enter_latency_max = latency;
+    }
+    restore_flags(flags);
     // clear buffer
     for(i = 0; i < BUFFER_W; i++)
         ((uint8_t*)buf)[i] = '\0';
@@ -10,6 +10,7 @@
 #include "../i8259.h"
 #include "../idt.h"
 #include "../syscalls.h"
+#include "../sched.h"
 #include "rtc.h"
 #include "../paging.h"
 //ESCAPE      0x01 
@@ -27,6 +28,8 @@
 #define UNCTRL      0x9D
 #define UNCHAR_L    0xA6
 #define CHAR_L      0x26
+#define CHAR_T      0x14
+#define CHAR_P      0x19
 #define UNALT       0xB8
 #define KEYB_IRQ    1
 
@@ -47,6 +50,16 @@ unsigned short shift;
 unsigned short capslock;
 /* flag to check if entered was recently pressed */
 unsigned short entered[3];
+/* tasks sleeping in stdin_read until enter is pressed or enough characters are typed */
+wait_queue_t stdin_wait[3];
+/* number of typed characters that completes the sleeping reader's request */
+unsigned short read_want[3];
+/* time stamp counter when enter was last pressed on each terminal */
+uint32_t enter_tsc[3];
+/* cycles from enter to the sleeping reader running again: last, running average (1/8 weight), worst */
+uint32_t enter_latency_last;
+uint32_t enter_latency_avg;
+uint32_t enter_latency_max;
 /* current terminal : 0, 1, or 2 */
 int current_terminal;
 
@@ -58,6 +71,10 @@ void init_terminal(void);
 void process_key(unsigned char scan_code);
 /* moves current keyboard buffer to the top */
 void buff_to_top(void);
+/* prints the cpu ticks each process has used (ctrl-t) */
+void print_cpu_status(void);
+/* switches between round robin and mlfq scheduling (ctrl-p) */
+void toggle_sched_policy(void);
 
 /* sys_read handlers for stdout and stdin */
 int32_t stdout_read (int32_t fd, void* buf, int32_t nbytes);
@@ -1,141 +1,280 @@
 #include "filesystem.h"
+#include "lib.h"
+#include "syscalls.h"
+
+/* Directory index: open-addressed hash tables filled once at boot. Each slot
+ * holds a dentry index + 1 so that 0 can mark an empty slot. */
+static uint8_t name_index[DENTRY_HASH_SIZE];
+static uint8_t inode_index[DENTRY_HASH_SIZE];
+
+/* name_length
+ *    INPUT: name - A file name, NUL terminated or exactly MAX_FILE_LENGTH bytes long.
+ * FUNCTION: Return the length of 'name', capped at MAX_FILE_LENGTH (dentry names are not always terminated).
+ */
+static uint32_t name_length(const uint8_t * name)
+{
+	uint32_t len = 0;
+	while(len < MAX_FILE_LENGTH && name[len] != '\0')
+		len++;
+	return len;
+}
+
+/* name_hash
+ *    INPUT: name - The file name to hash.
+ 			 len - The number of characters of 'name' to hash.
+ * FUNCTION: FNV-1a hash of the first 'len' characters of 'name', folded onto the table size.
+ */
+static uint32_t name_hash(const uint8_t * name, uint32_t len)
+{
+	uint32_t hash = FNV_OFFSET_BASIS;
+	uint32_t i;
+	for(i = 0; i < len; i++) {
+		hash ^= name[i];
+		hash *= FNV_PRIME;
+	}
+	return hash & (DENTRY_HASH_SIZE - 1);
+}
+
+/* build_dentry_index
+ *    INPUT: none
+ * FUNCTION: Hash every dentry in the boot block by name and by inode number. When several
+ *           dentries share an inode (the rtc and '.' both use inode 0) the first one is kept,
+ *           which is what the old linear scan returned.
+ */
+static void build_dentry_index(void)
+{
+	uint32_t dentry_index, slot;
+	uint32_t num_dentries = boot_block->num_dentries;
+	dentry_t * dentry;
+
+	memset(name_index, 0, sizeof(name_index));
+	memset(inode_index, 0, sizeof(inode_index));
+	if(num_dentries > MAX_DENTRIES)
+		num_dentries = MAX_DENTRIES;
+
+	for(dentry_index = 0; dentry_index < num_dentries; dentry_index++) {
+		dentry = &boot_block->dentries[dentry_index];
+
+		slot = name_hash(dentry->file_name, name_length(dentry->file_name));
+		while(name_index[slot] != 0)
+			slot = (slot + 1) & (DENTRY_HASH_SIZE - 1);
+		name_index[slot] = dentry_index + 1;
+
+		slot = dentry->inode_number & (DENTRY_HASH_SIZE - 1);
+		while(inode_index[slot] != 0 &&
+			  boot_block->dentries[inode_index[slot] - 1].inode_number != dentry->inode_number)
+			slot = (slot + 1) & (DENTRY_HASH_SIZE - 1);
+		if(inode_index[slot] == 0)
+			inode_index[slot] = dentry_index + 1;
+	}
+}
 
 /* initialize_file_system
  *    INPUT: file_system_start_address - The address of the boot block which is at the start of the file system.
- * FUNCTION: Save the address of the boot block locally.
+ * FUNCTION: Save the address of the boot block locally and build the directory index.
  */
 void initialize_file_system(void * file_system_start_address)
 {
 	boot_block = (file_system_statistics_t *)file_system_start_address;
+	build_dentry_index();
 }
 
 /* read_dentry_by_name
  *    INPUT: filename - The name of the rtc, file, or directory to read.
  			 dentry - A pointer to memory to store the directory that we read.
- * FUNCTION: Search the file system for a directory entry with the name 'filename' and store it back in the 'dentry'.
+ * FUNCTION: Look 'filename' up in the name index and store its directory entry back in 'dentry'.
+ *           Names are compared on at most MAX_FILE_LENGTH characters, as before.
  */
 int32_t read_dentry_by_name(const uint8_t* filename, dentry_t* dentry)
 {
-	if(dentry == NULL)
+	if(dentry == NULL || filename == NULL)
 		return -1;
-	uint32_t dentry_index = 0;
-    int len_input = strlen((int8_t *)filename);
-    int len_file, length;
-    dentry_t * searched_dentry = (dentry_t *)(boot_block);
-    searched_dentry += FIRST_FILE_OR_FOLDER_OFFSET;
-
-    for(dentry_index = 0; dentry_index < boot_block->num_dentries; dentry_index++) {
-    	len_file = strlen((int8_t*)searched_dentry->file_name);
-    	length = (len_file > len_input) ? len_file : len_input;
-    	length = (length > MAX_FILE_LENGTH) ? MAX_FILE_LENGTH : length;
-    	if(strncmp((int8_t*)searched_dentry->file_name, (int8_t *)filename, length) == 0) {
-    		memcpy(dentry, searched_dentry, sizeof(dentry_t));
-    		return 0;
-    	}
-    	searched_dentry += 1;
-    }
+	uint32_t len_input = name_length(filename);
+	uint32_t slot = name_hash(filename, len_input);
+	dentry_t * searched_dentry;
+
+	// probe until an empty slot; the table is never full (MAX_DENTRIES < DENTRY_HASH_SIZE)
+	while(name_index[slot] != 0) {
+		searched_dentry = &boot_block->dentries[name_index[slot] - 1];
+		if(name_length(searched_dentry->file_name) == len_input &&
+		   strncmp((int8_t*)searched_dentry->file_name, (int8_t *)filename, len_input) == 0) {
+			memcpy(dentry, searched_dentry, sizeof(dentry_t));
+			return 0;
+		}
+		slot = (slot + 1) & (DENTRY_HASH_SIZE - 1);
+	}
 	return -1;
 }
 
 /* read_dentry_by_index
- *    INPUT: index - The index into the directory entries in the boot block.
+ *    INPUT: index - The inode number of the directory entry to fetch.
  			 dentry - A pointer to the memory to store the directory that we read.
- * FUNCTION: Fetch the directory entry that is at index 'index' and store it in 'dentry'.
+ * FUNCTION: Fetch the directory entry for inode 'index' from the inode index and store it in 'dentry'.
  */
 int32_t read_dentry_by_index(uint32_t index, dentry_t* dentry)
 {
-	if(index < 0 || index >= boot_block->num_inodes || dentry == NULL)
+	if(index >= boot_block->num_inodes || dentry == NULL)
 	{
 		return -1;
 	}
-	dentry_t * searched_dentry = (dentry_t *)(boot_block);
-	searched_dentry += FIRST_FILE_OR_FOLDER_OFFSET;
-	uint32_t inode_index = 0;
-	for(inode_index = 0; inode_index < boot_block->num_inodes; inode_index++)
+	uint32_t slot = index & (DENTRY_HASH_SIZE - 1);
+	dentry_t * searched_dentry;
+	while(inode_index[slot] != 0)
 	{
+		searched_dentry = &boot_block->dentries[inode_index[slot] - 1];
 		if(searched_dentry->inode_number == index)
 		{
 			memcpy(dentry, searched_dentry, sizeof(dentry_t));
 			return 0;
 		}
-		searched_dentry++;
+		slot = (slot + 1) & (DENTRY_HASH_SIZE - 1);
 	}
 	return -1;
 }
 
-/* read_data
- *    INPUT: inode - The inode of the directory that we wish to read.
- 			 offset - This is the offset in bytes into the file that we wish to read.
- 			 buf - The buffer to store the read data into.
- 			 length - The length in bytes of the file that we wish to read.
- * FUNCTION: Read 'length' raw bytes starting at 'offset' into the 'inode' and store it into the buffer 'buf'.
+/* get_inode
+ *    INPUT: inode - The number of the inode to locate.
+ * FUNCTION: Return a pointer to the inode block 'inode' (the boot block is block 0).
  */
-int32_t read_data(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length)
+static inode_t * get_inode(uint32_t inode)
 {
-	if(inode < 0 || inode >= boot_block->num_inodes || buf == NULL || length <= 0)
-		return -1;
-
-	//GO TO INODE
-	uint8_t * find_inode = (uint8_t *)(boot_block);
-	find_inode += BLOCK_SIZE; //jump past the boot block
-	find_inode += inode * BLOCK_SIZE; //select the correct inode
-	inode_t * selected_inode = (inode_t *)find_inode;
-	//GO TO INODE
+	return (inode_t *)boot_block + INODE_OFFSET_IN_BLOCKS + inode;
+}
 
-	if(selected_inode->length_in_bytes <= 0)
-	{
-		return 0;
-	}
+/* get_dblock
+ *    INPUT: dblock - The number of the data block to locate.
+ * FUNCTION: Return a pointer to data block 'dblock', or NULL if it is past the end of the image.
+ */
+static uint8_t * get_dblock(uint32_t dblock)
+{
+	if(dblock >= boot_block->num_blocks)
+		return NULL;
+	dblock_t * dblock_zero = (dblock_t *)boot_block + INODE_OFFSET_IN_BLOCKS + boot_block->num_inodes;
+	return (uint8_t *)(dblock_zero + dblock);
+}
 
-	//CALCULATE INODE DATA BLOCK OFFSET
-	uint32_t inode_dblock_offset = offset / BLOCK_SIZE;
-	uint32_t dblock_offset = offset % BLOCK_SIZE;
-	uint32_t curr_dblock = selected_inode->dblock_refs[inode_dblock_offset];
-	//CALCULATE INODE DATA BLOCK OFFSET
+/* cursor_init
+ *    INPUT: cursor - The cursor to set up.
+ 			 inode - The inode of the regular file the cursor reads.
+ * FUNCTION: Point 'cursor' at the start of file 'inode'. The first data block is resolved lazily on the first read.
+ */
+void cursor_init(file_cursor_t * cursor, uint32_t inode)
+{
+	cursor->inode = (inode < boot_block->num_inodes) ? get_inode(inode) : NULL;
+	cursor->inode_num = inode;
+	cursor->file_pos = 0;
+	cursor->block_ptr = NULL;
+	cursor->block_index = 0;
+	cursor->block_offset = 0;
+}
 
-	if(curr_dblock < 0)
-		return -1;
+/* cursor_seek
+ *    INPUT: cursor - The cursor to move.
+ 			 file_pos - The new byte offset into the file.
+ * FUNCTION: Move 'cursor' to 'file_pos'. The cached block is kept if the new position is still inside it.
+ */
+void cursor_seek(file_cursor_t * cursor, uint32_t file_pos)
+{
+	if(cursor->block_ptr != NULL && file_pos / BLOCK_SIZE == cursor->block_index)
+		cursor->block_offset = file_pos % BLOCK_SIZE;
+	else
+		cursor->block_ptr = NULL;
+	cursor->file_pos = file_pos;
+}
 
-	//FIND DATA BLOCK ZERO
-	dblock_t * dblock_zero = (dblock_t *)boot_block;
-	dblock_zero += INODE_OFFSET_IN_BLOCKS;
-	dblock_zero += boot_block->num_inodes;
-	//FIND DATA BLOCK ZERO
+/* cursor_read
+ *    INPUT: cursor - The cursor of the open file; advanced past the bytes read.
+ 			 buf - The buffer to store the read data into.
+ 			 length - The maximum number of bytes to read.
+ * FUNCTION: Copy up to 'length' bytes at the cursor into 'buf'. Each 4 KB data block run is moved with one
+ *           memcpy (single bytes with a plain store), and the block pointer is only re-derived when a run crosses
+ *           into the next block, so back-to-back small reads cost a few instructions each.
+ *           Returns the number of bytes read, 0 at EOF, or -1 on a bad cursor or a corrupt block reference.
+ */
+int32_t cursor_read(file_cursor_t * cursor, uint8_t * buf, uint32_t length)
+{
+	inode_t * selected_inode = cursor->inode;
+	uint32_t bytes_copied = 0;
+	uint32_t run;
 
-	//GET POINTER TO FIRST DATA BLOCK WITH OFFSET
-	uint8_t * curr_dblock_ptr = (uint8_t *)dblock_zero;
-	curr_dblock_ptr += BLOCK_SIZE * curr_dblock;
-	curr_dblock_ptr += dblock_offset;
-	//GET POINTER TO FIRST DATA BLOCK WITH OFFSET
+	if(selected_inode == NULL || buf == NULL || length == 0)
+		return -1;
 
-	//LOOP THROUGH THE INODE DATA BLOCKS COPYING MEMORY INTO BUF
-	uint32_t data_byte_index = 0;
-	uint32_t bytes_copied = 0;
-	uint32_t remaining_length = 0;
-	if(length > selected_inode->length_in_bytes - offset)
-		remaining_length = selected_inode->length_in_bytes - offset;
-	else
-		remaining_length = length;
+	if(cursor->file_pos >= selected_inode->length_in_bytes)
+		return 0; // EOF (also covers empty files)
 
-	if(offset > selected_inode->length_in_bytes)
-		return 0; //EOF CONDITION OR ERROR CONDITION?
+	if(length > selected_inode->length_in_bytes - cursor->file_pos)
+		length = selected_inode->length_in_bytes - cursor->file_pos;
 
-	for(data_byte_index = 0; data_byte_index < remaining_length; data_byte_index++) {
-		if((offset+data_byte_index) % BLOCK_SIZE == 0 && data_byte_index !=0) {
-			inode_dblock_offset++;
-			if(inode_dblock_offset >= NUM_DBLOCK_REFS)
+	while(bytes_copied < length) {
+		if(cursor->block_ptr == NULL) {
+			// only reached on the first read, after a seek, or at a block boundary
+			cursor->block_index = cursor->file_pos / BLOCK_SIZE;
+			cursor->block_offset = cursor->file_pos % BLOCK_SIZE;
+			if(cursor->block_index >= NUM_DBLOCK_REFS)
+				return -1;
+			cursor->block_ptr = get_dblock(selected_inode->dblock_refs[cursor->block_index]);
+			if(cursor->block_ptr == NULL)
 				return -1;
-			curr_dblock = selected_inode->dblock_refs[inode_dblock_offset];
-			curr_dblock_ptr = (uint8_t *)dblock_zero;
-			curr_dblock_ptr += BLOCK_SIZE * curr_dblock;
 		}
-		memcpy(buf, curr_dblock_ptr, 1);
-		curr_dblock_ptr++;
-		buf++;
-		bytes_copied++;
+
+		// copy up to the end of this block or the end of the request, whichever is first
+		run = BLOCK_SIZE - cursor->block_offset;
+		if(run > length - bytes_copied)
+			run = length - bytes_copied;
+		if(run == 1)
+			buf[bytes_copied] = cursor->block_ptr[cursor->block_offset];
+		else
+			memcpy(buf + bytes_copied, cursor->block_ptr + cursor->block_offset, run);
+
+		bytes_copied += run;
+		cursor->file_pos += run;
+		cursor->block_offset += run;
+		if(cursor->block_offset == BLOCK_SIZE)
+			cursor->block_ptr = NULL;
 	}
 	return bytes_copied;
-	//LOOP THROUGH THE INODE DATA BLOCKS COPYING MEMORY INTO BUF
+}
+
+/* cursor_block
+ *    INPUT: cursor - An open regular file.
+ 			 block_index - Index of the data block within the file.
+ * FUNCTION: Return a pointer to data block 'block_index' of the cursor's file inside the
+ *           in-memory filesystem image, or NULL if the file has no such block.
+ */
+uint8_t * cursor_block(file_cursor_t * cursor, uint32_t block_index)
+{
+	if(cursor->inode == NULL || block_index >= NUM_DBLOCK_REFS ||
+	   block_index * BLOCK_SIZE >= cursor->inode->length_in_bytes)
+		return NULL;
+	return get_dblock(cursor->inode->dblock_refs[block_index]);
+}
+
+/* fs_blocks_page_aligned
+ *    INPUT: none
+ * FUNCTION: Return 1 if the filesystem image (and so every data block) starts on a 4 KB page
+ *           boundary, which is needed to map data blocks straight into user space.
+ */
+int32_t fs_blocks_page_aligned(void)
+{
+	return ((uint32_t)boot_block & (BLOCK_SIZE - 1)) == 0;
+}
+
+/* read_data
+ *    INPUT: inode - The inode of the directory that we wish to read.
+ 			 offset - This is the offset in bytes into the file that we wish to read.
+ 			 buf - The buffer to store the read data into.
+ 			 length - The length in bytes of the file that we wish to read.
+ * FUNCTION: Read 'length' raw bytes starting at 'offset' into the 'inode' and store it into the buffer 'buf'.
+ */
+int32_t read_data(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length)
+{
+	file_cursor_t cursor;
+	if(inode >= boot_block->num_inodes)
+		return -1;
+	cursor_init(&cursor, inode);
+	cursor_seek(&cursor, offset);
+	return cursor_read(&cursor, buf, length);
 }
 
 /* read_data_corr_sig
@@ -146,77 +285,10 @@ int32_t read_data(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length
  */
 int32_t read_data_corr_sig(uint32_t fd, uint8_t* buf, uint32_t length)
 {
-	PCB* pcb = get_pcb_ptr();
+	PCB* pcb = get_group_ptr();
 	if(pcb == NULL)
 		return -1;
-	uint32_t inode = pcb->fd[fd].inode_num;
-	uint32_t offset = pcb->fd[fd].file_pos;
-	if(inode < 0 || inode >= boot_block->num_inodes || buf == NULL || length <= 0)
-		return -1;
-
-	//GO TO INODE
-	uint8_t * find_inode = (uint8_t *)(boot_block);
-	find_inode += BLOCK_SIZE; //jump past the boot block
-	find_inode += inode * BLOCK_SIZE; //select the correct inode
-	inode_t * selected_inode = (inode_t *)find_inode;
-	//
-
-	if(selected_inode->length_in_bytes <= 0)
-		return 0;
-
-	//CALCULATE INODE DATA BLOCK OFFSET
-	uint32_t inode_dblock_offset = offset / BLOCK_SIZE;
-	uint32_t dblock_offset = offset % BLOCK_SIZE;
-	uint32_t curr_dblock = selected_inode->dblock_refs[inode_dblock_offset];
-	//
-
-	if(curr_dblock < 0)
-		return -1;
-
-	//FIND DATA BLOCK ZERO
-	dblock_t * dblock_zero = (dblock_t *)boot_block;
-	dblock_zero += INODE_OFFSET_IN_BLOCKS;
-	dblock_zero += boot_block->num_inodes;
-	//
-
-	//GET POINTER TO FIRST DATA BLOCK WITH OFFSET
-	uint8_t * curr_dblock_ptr = (uint8_t *)dblock_zero;
-	curr_dblock_ptr += BLOCK_SIZE * curr_dblock;
-	curr_dblock_ptr += dblock_offset;
-	//
-
-	//LOOP THROUGH THE INODE DATA BLOCKS COPYING MEMORY INTO BUF
-	uint32_t data_byte_index = 0;
-	uint32_t bytes_copied = 0;
-	uint32_t remaining_length = 0;
-	if(length >= selected_inode->length_in_bytes - offset)
-		remaining_length = selected_inode->length_in_bytes - offset;
-	else
-		remaining_length = length;
-
-	if(offset >= selected_inode->length_in_bytes)
-		return 0; //EOF CONDITION OR ERROR CONDITION?
-	for(data_byte_index = 0; data_byte_index < remaining_length; data_byte_index++) {
-		if((offset+data_byte_index) % BLOCK_SIZE == 0 && data_byte_index !=0) {
-			inode_dblock_offset++;
-			if(inode_dblock_offset >= NUM_DBLOCK_REFS)
-				return -1;
-			curr_dblock = selected_inode->dblock_refs[inode_dblock_offset];
-			curr_dblock_ptr = (uint8_t *)dblock_zero;
-			curr_dblock_ptr += BLOCK_SIZE * curr_dblock;
-		}
-		if(curr_dblock_ptr==NULL || buf ==NULL)
-		{
-			return bytes_copied;
-		}
-		memcpy(buf, curr_dblock_ptr, 1);
-		curr_dblock_ptr++;
-		buf++;
-		bytes_copied++;
-		pcb->fd[fd].file_pos++;
-	}
-	return bytes_copied;
-	//
+	return cursor_read(&pcb->fd[fd].cursor, buf, length);
 }
 
 /* file_write
@@ -266,8 +338,8 @@ uint32_t directory_close (int32_t fd)
 uint32_t read_directory (int32_t fd, void* buf, int32_t nbytes)
 {
 	// get pcb to access fd
-	PCB* pcb = get_pcb_ptr();
-	uint32_t offset = pcb->fd[fd].file_pos;
+	PCB* pcb = get_group_ptr();
+	uint32_t offset = pcb->fd[fd].cursor.file_pos;
 	// check if offset reading blocks without file name
 	if(boot_block->dentries[offset].file_name[0] == '\0')
 		return 0;
@@ -277,7 +349,7 @@ uint32_t read_directory (int32_t fd, void* buf, int32_t nbytes)
 	// copy to buffer
 	strncpy((int8_t*) buf, (int8_t*)boot_block->dentries[offset].file_name, length);
 	// update position for subsequent reads
-	pcb->fd[fd].file_pos++;
+	pcb->fd[fd].cursor.file_pos++;
 	return length;
 }
 
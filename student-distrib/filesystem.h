@@ -2,8 +2,6 @@
 #define _filesystem_H
 
 #include "types.h"
-#include "lib.h"
-#include "drivers/terminal.h"
 
 #define NUM_DBLOCK_REFS 1023
 #define BLOCK_SIZE 4096
@@ -14,6 +12,10 @@
 #define DIRECTORYFILETYPE 1
 #define REGULARFILETYPE 2
 #define MAX_FILE_LENGTH 32
+#define MAX_DENTRIES 63
+#define DENTRY_HASH_SIZE 128 // power of two, about twice MAX_DENTRIES
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619
 
 typedef struct
 {
@@ -31,7 +33,7 @@ typedef struct
 	uint32_t num_blocks; // 4
 	uint8_t reserved[52]; // 1 * 52 = 52
 	// = 64
-	dentry_t dentries[63]; // 63 * 64 = 4032
+	dentry_t dentries[MAX_DENTRIES]; // 63 * 64 = 4032
 	// = 4096
 } file_system_statistics_t;
 
@@ -48,6 +50,26 @@ typedef struct
 	// = 4096
 } dblock_t;
 
+/* Open-file cursor kept in every file descriptor. For regular files it caches
+ * the resolved inode and the data block holding file_pos, so sequential reads
+ * pick up where the last one stopped. Directories only use file_pos (the next
+ * dentry to list). */
+typedef struct __attribute__((packed)) file_cursor
+{
+	inode_t * inode; // NULL for rtc, directory and terminal fds
+	uint32_t inode_num;
+	uint32_t file_pos; // byte offset into the file
+	uint8_t * block_ptr; // data block holding file_pos, NULL until resolved
+	uint32_t block_index; // index of block_ptr in inode->dblock_refs
+	uint32_t block_offset; // file_pos % BLOCK_SIZE while block_ptr is valid
+} file_cursor_t;
+
+void cursor_init(file_cursor_t * cursor, uint32_t inode);
+int32_t cursor_read(file_cursor_t * cursor, uint8_t * buf, uint32_t length);
+void cursor_seek(file_cursor_t * cursor, uint32_t file_pos);
+uint8_t * cursor_block(file_cursor_t * cursor, uint32_t block_index);
+int32_t fs_blocks_page_aligned(void);
+
 uint32_t open_file(const uint8_t * filename, dentry_t * dentry);
 int32_t read_dentry_by_name(const uint8_t* filename, dentry_t* dentry);
 int32_t read_dentry_by_index(uint32_t index, dentry_t* dentry);
@@ -0,0 +1,175 @@
+#include "frame.h"
+#include "lib.h"
+
+/* One bit per 4 KB frame below FRAME_MEMORY_LIMIT, set = in use (or not RAM).
+ * Every frame starts out used and frame_init clears the ones the memory map
+ * reports as available. */
+static uint32_t frame_bitmap[FRAME_BITMAP_WORDS];
+static uint32_t next_word; // word where the last search succeeded, searches start here
+/* Users of each frame that is in use, more than one once fork shares it copy-on-write */
+static uint8_t frame_refs[NUM_FRAMES];
+
+/* frame_mark_free
+ *    INPUT: start - physical address of the first byte of the range
+ *           end - physical address one past the last byte of the range
+ * FUNCTION: marks every whole frame inside [start, end) that the allocator manages as free
+ */
+static void frame_mark_free(uint32_t start, uint32_t end)
+{
+	uint32_t frame;
+	if(start < FRAME_FIRST_ADDRESS)
+		start = FRAME_FIRST_ADDRESS;
+	if(end > FRAME_MEMORY_LIMIT)
+		end = FRAME_MEMORY_LIMIT;
+	if(end <= start)
+		return;
+	start = (start + FRAME_SIZE - 1) & ~(FRAME_SIZE - 1); // round in to whole frames
+	end &= ~(FRAME_SIZE - 1);
+
+	for(frame = start >> FRAME_SHIFT; frame < (end >> FRAME_SHIFT); frame++) {
+		if(frame_bitmap[frame / 32] & (1u << (frame % 32))) {
+			frame_bitmap[frame / 32] &= ~(1u << (frame % 32));
+			frames_free++;
+			frames_total++;
+		}
+	}
+}
+
+/* frame_init
+ *    INPUT: mbi - multiboot information from the boot loader
+ * FUNCTION: seeds the allocator with every available region of the multiboot memory map that lies
+ *           between FRAME_FIRST_ADDRESS and FRAME_MEMORY_LIMIT. Falls back to mem_upper if the
+ *           boot loader gave no map
+ */
+void frame_init(multiboot_info_t * mbi)
+{
+	memory_map_t * mmap;
+
+	memset(frame_bitmap, 0xFF, sizeof(frame_bitmap));
+	frames_free = 0;
+	frames_total = 0;
+	next_word = 0;
+
+	if(mbi->flags & (1 << 6)) { // mmap_* valid
+		for (mmap = (memory_map_t *) mbi->mmap_addr;
+				(unsigned long) mmap < mbi->mmap_addr + mbi->mmap_length;
+				mmap = (memory_map_t *) ((unsigned long) mmap
+					+ mmap->size + sizeof (mmap->size))) {
+			// regions that start above 4 GB are out of reach, ones that end above it are clipped
+			if(mmap->type != MMAP_TYPE_AVAILABLE || mmap->base_addr_high != 0)
+				continue;
+			if(mmap->length_high != 0 || mmap->base_addr_low + mmap->length_low < mmap->base_addr_low)
+				frame_mark_free(mmap->base_addr_low, FRAME_MEMORY_LIMIT);
+			else
+				frame_mark_free(mmap->base_addr_low, mmap->base_addr_low + mmap->length_low);
+		}
+	}
+	else if(mbi->flags & (1 << 0)) { // mem_* valid
+		frame_mark_free(LOW_MEMORY_END, LOW_MEMORY_END + (mbi->mem_upper << KB_SHIFT));
+	}
+	printf("%d MB of memory for programs (%d frames)\n", (frames_total * FRAME_SIZE) >> MB_SHIFT, frames_total);
+}
+
+/* frame_alloc
+ *    INPUT: none
+ * FUNCTION: takes the first free frame at or after the last allocation (full words are skipped
+ *           32 frames at a time) and returns its physical address, or 0 if there are none left
+ */
+uint32_t frame_alloc(void)
+{
+	uint32_t i, word, bit;
+	if(frames_free == 0)
+		return 0;
+	for(i = 0; i < FRAME_BITMAP_WORDS; i++) {
+		word = (next_word + i) % FRAME_BITMAP_WORDS;
+		if(frame_bitmap[word] == 0xFFFFFFFF)
+			continue;
+		for(bit = 0; frame_bitmap[word] & (1u << bit); bit++);
+		frame_bitmap[word] |= 1u << bit;
+		frames_free--;
+		next_word = word;
+		frame_refs[word * 32 + bit] = 1;
+		return (word * 32 + bit) << FRAME_SHIFT;
+	}
+	return 0;
+}
+
+/* frame_alloc_contig
+ *    INPUT: count - number of frames, a power of two no larger than 32
+ * FUNCTION: finds 'count' free frames in a row starting on a multiple of 'count' (so an 8 KB kernel
+ *           stack is 8 KB aligned) and returns the physical address of the first, or 0 on failure
+ */
+uint32_t frame_alloc_contig(uint32_t count)
+{
+	uint32_t word, bit, mask, i;
+	if(count == 0 || count > 32 || (count & (count - 1)) || frames_free < count)
+		return 0;
+	mask = (count == 32) ? 0xFFFFFFFF : ((1u << count) - 1);
+	for(word = 0; word < FRAME_BITMAP_WORDS; word++) {
+		for(bit = 0; bit < 32; bit += count) {
+			if(frame_bitmap[word] & (mask << bit))
+				continue;
+			frame_bitmap[word] |= mask << bit;
+			frames_free -= count;
+			for(i = 0; i < count; i++)
+				frame_refs[word * 32 + bit + i] = 1;
+			return (word * 32 + bit) << FRAME_SHIFT;
+		}
+	}
+	return 0;
+}
+
+/* frame_get
+ *    INPUT: address - physical address of a frame in use
+ * FUNCTION: counts one more user of the frame, it is only freed once every user has called frame_free
+ */
+void frame_get(uint32_t address)
+{
+	if(address < FRAME_FIRST_ADDRESS || address >= FRAME_MEMORY_LIMIT)
+		return;
+	frame_refs[address >> FRAME_SHIFT]++;
+}
+
+/* frame_refcount
+ *    INPUT: address - physical address of a frame
+ * FUNCTION: returns how many users the frame has, 0 if it is free or not managed by the allocator
+ */
+uint32_t frame_refcount(uint32_t address)
+{
+	if(address < FRAME_FIRST_ADDRESS || address >= FRAME_MEMORY_LIMIT)
+		return 0;
+	return frame_refs[address >> FRAME_SHIFT];
+}
+
+/* frame_free
+ *    INPUT: address - physical address returned by frame_alloc
+ * FUNCTION: drops one user of the frame and marks it free again once it has none left,
+ *           addresses the allocator does not manage are ignored
+ */
+void frame_free(uint32_t address)
+{
+	uint32_t frame = address >> FRAME_SHIFT;
+	if(address < FRAME_FIRST_ADDRESS || address >= FRAME_MEMORY_LIMIT)
+		return;
+	if(!(frame_bitmap[frame / 32] & (1u << (frame % 32))))
+		return; // already free
+	if(frame_refs[frame] > 1) {
+		frame_refs[frame]--; // still shared
+		return;
+	}
+	frame_refs[frame] = 0;
+	frame_bitmap[frame / 32] &= ~(1u << (frame % 32));
+	frames_free++;
+}
+
+/* frame_free_contig
+ *    INPUT: address - physical address returned by frame_alloc_contig
+ *           count - the count it was allocated with
+ * FUNCTION: frees each frame of the run
+ */
+void frame_free_contig(uint32_t address, uint32_t count)
+{
+	uint32_t i;
+	for(i = 0; i < count; i++)
+		frame_free(address + i * FRAME_SIZE);
+}
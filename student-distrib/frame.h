@@ -0,0 +1,40 @@
+/* frame.h - Physical page frame allocator
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _frame_H
+#define _frame_H
+
+#include "types.h"
+#include "multiboot.h"
+
+#define FRAME_SIZE 4096
+#define FRAME_SHIFT 12
+#define FRAME_FIRST_ADDRESS 0x800000 // below 8 MB is the kernel, its module and the boot stack
+#define FRAME_MEMORY_LIMIT 0x8000000 // only memory under 128 MB is handed out, the kernel direct-maps it
+#define NUM_FRAMES (FRAME_MEMORY_LIMIT / FRAME_SIZE)
+#define FRAME_BITMAP_WORDS (NUM_FRAMES / 32)
+#define MMAP_TYPE_AVAILABLE 1 // multiboot memory map type for usable RAM
+#define KB_SHIFT 10
+#define MB_SHIFT 20
+#define LOW_MEMORY_END 0x100000 // mem_upper counts from 1 MB
+
+/* Build the free bitmap from the multiboot memory map (or mem_upper if there is no map) */
+void frame_init(multiboot_info_t * mbi);
+/* Allocate one 4 KB frame, returns its physical address or 0 if memory is exhausted */
+uint32_t frame_alloc(void);
+/* Allocate 'count' (a power of two) contiguous frames aligned to their total size, 0 on failure */
+uint32_t frame_alloc_contig(uint32_t count);
+/* One more user of a frame (a page shared copy-on-write) */
+void frame_get(uint32_t address);
+/* Users of a frame, 0 if it is free */
+uint32_t frame_refcount(uint32_t address);
+/* Drop one user of a frame, it returns to the allocator with the last */
+void frame_free(uint32_t address);
+/* Return 'count' contiguous frames to the allocator */
+void frame_free_contig(uint32_t address, uint32_t count);
+
+uint32_t frames_free; // frames currently available
+uint32_t frames_total; // frames the memory map gave us
+
+#endif /* _frame_H */
@@ -0,0 +1,73 @@
+#include "futex.h"
+#include "syscalls.h"
+
+/* Tasks sleeping in futex_wait. Words whose keys share a bucket share its
+ * queue, so every sleeper keeps its own key in its PCB and wakers skip the
+ * ones that don't match. */
+static wait_queue_t futex_queues[FUTEX_HASH_SIZE];
+
+/* futex_bucket
+ *    INPUT: key - physical address of a futex word
+ * FUNCTION: returns the queue of the bucket 'key' hashes to. Neighbouring words and the same
+ *           word of different pages both spread out
+ */
+static wait_queue_t * futex_bucket(uint32_t key)
+{
+	return &futex_queues[((key >> 2) ^ (key >> FRAME_SHIFT)) & (FUTEX_HASH_SIZE - 1)];
+}
+
+/* futex_init
+ *    INPUT: none
+ * FUNCTION: empties every bucket
+ */
+void futex_init(void)
+{
+	uint32_t i;
+	for(i = 0; i < FUTEX_HASH_SIZE; i++)
+		wait_queue_init(&futex_queues[i]);
+}
+
+/* futex_wait
+ *    INPUT: key - physical address of the word
+ *           addr - the word as the caller maps it
+ *           val - value the caller last saw in it
+ * FUNCTION: sleeps until futex_wake on 'key' if the word still holds 'val'; the check and going to
+ *           sleep happen with interrupts off, so a wake after the caller changed the word is never
+ *           missed. Returns 0 once woken, -1 straight away if the word changed or the process is
+ *           exiting
+ */
+int32_t futex_wait(uint32_t key, volatile uint32_t * addr, uint32_t val)
+{
+	PCB * task = get_pcb_ptr();
+	if(*addr != val || get_group_ptr()->exiting)
+		return -1; // changed, or the process ended and the thread halts on its way out
+	task->futex_key = key;
+	sleep_on(futex_bucket(key));
+	task->futex_key = 0;
+	return 0;
+}
+
+/* futex_wake
+ *    INPUT: key - physical address of the word
+ *           count - most tasks to wake
+ * FUNCTION: wakes the oldest sleepers on 'key', up to 'count' of them. Returns how many woke
+ */
+int32_t futex_wake(uint32_t key, uint32_t count)
+{
+	wait_queue_t * queue = futex_bucket(key);
+	sched_node_t * node = queue->head.next;
+	sched_node_t * next;
+	PCB * task;
+	int32_t woken = 0;
+
+	while(node != &queue->head && (uint32_t)woken < count) {
+		next = node->next;
+		task = task_of(node);
+		if(task->futex_key == key) {
+			wake_up_task(task);
+			woken++;
+		}
+		node = next;
+	}
+	return woken;
+}
@@ -0,0 +1,22 @@
+/* futex.h - Wait queues for user space locks, keyed by physical address
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _futex_H
+#define _futex_H
+
+#include "types.h"
+#include "sched.h"
+
+#define FUTEX_WAIT 0 // sys_futex op: sleep while the word still holds val
+#define FUTEX_WAKE 1 // sys_futex op: wake up to val sleepers
+#define FUTEX_HASH_SIZE 32 // buckets, a power of two
+
+/* empty every bucket */
+void futex_init(void);
+/* sleep on 'key' if *addr still equals val (0 once woken, -1 if it did not), interrupts off */
+int32_t futex_wait(uint32_t key, volatile uint32_t * addr, uint32_t val);
+/* wake up to 'count' tasks sleeping on 'key' and return how many woke, interrupts off */
+int32_t futex_wake(uint32_t key, uint32_t count);
+
+#endif /* _futex_H */
@@ -84,12 +84,26 @@ void EXCEPD()
 }
 void EXCEPE()
 {
-    uint32_t pfa;
+    asm volatile("pushal;");
+    uint32_t pfa, error_code;
     asm("movl %%cr2, %%eax;"
         : "=a"(pfa)
         : // no input
         : "cc"
         );
+    asm("movl 4(%%ebp), %%eax;" // cpu pushed the error code just above our saved ebp
+        : "=a"(error_code)
+        : // no input
+        : "cc"
+        );
+
+    // first touch of a program page: fill it from the executable and retry the access
+    if(!(error_code & PF_PRESENT) && load_program_page(pfa) == 0)
+        asm volatile("popal; leave; addl $4, %esp; iret;"); // pop the error code before iret
+    // write to a page shared copy-on-write since fork: copy it and retry the access
+    if((error_code & PF_PRESENT) && (error_code & PF_WRITE) && copy_program_page(pfa) == 0)
+        asm volatile("popal; leave; addl $4, %esp; iret;");
+
     printf("Page fault at %d\n", pfa);
     excep_loop();
 }
@@ -178,82 +192,36 @@ void RTC_HANDLER()
     asm volatile("popal; leave; iret;");
 }
 
-/* PIT_HANDLER
+/* pit_interrupt
        Input: none
-    Function: Handles PIT interrupts, also performs task scheduling
+    Function: Handles PIT interrupts, also performs task scheduling. Called from the PIT_HANDLER
+              stub in switch.S, which saves every register, so switching tasks in here is safe
  */
-void PIT_HANDLER()
+void pit_interrupt()
 {
-    cli();
-    asm volatile("pushal;");
-    timer_ticks++;
-
-    // mod 2 to get interrupts every 20 ms
-    if(timer_ticks % 2 == 0){
-
-        PCB * pcb = get_pcb_ptr();
-        
-        // ---------- IF FIRST 2 START SHELLS AND EXECUTE---------- //
-        if(timer_ticks <= THIRD_QUANT){ // start next two shells
-            if(timer_ticks == FIRST_QUANT)
-                current_terminal = 1; 
-            else if(timer_ticks == SECOND_QUANT)
-                current_terminal = 2;
-            // save esp and ebp
-            asm volatile("movl %%esp, %0;" : "=r"(pcb->esp));
-            asm volatile("movl %%ebp, %0;" : "=r"(pcb->ebp));
-            //
-            sti();
-            send_eoi(PIT_IRQ);
-            sys_execute((uint8_t*)"shell");
-            asm volatile("popal; leave; iret;");
-        }
-        else {
-            // ---------- CHECK IF PROCESSES TO SWITCH TO AND GET PID ---------- //
-            PCB * next_pcb;
-            int next = 0, prev_process = running_process;
-            while(!next){
-                running_process = (running_process+1)%MAX_NUM_PROCESSES;  // go to next process
-                if(running_process == prev_process)
-                    break;
-                if(process_array[running_process]){
-                    //check if ! a process with parent
-                    next_pcb = (PCB*)(_8MB - _8KB * (running_process + 1) );
-                    if(next_pcb->child == -1){ // check if has no children processes
-                        next = 1;
-                    }
-                }
-            }
-
-            //printf(" %d ", running_process, next);
-            // ---------- CONTEXT SWITCH IF NEXT ---------- //
-            if(next) {
-
-                asm volatile("movl %%esp, %0;" : "=r"(pcb->esp));
-                asm volatile("movl %%ebp, %0;" : "=r"(pcb->ebp));
-
-                program_paging(_8MB + ((running_process) * _4MB));      // change to next processes page
-                tss.esp0 = _8MB - _8KB * (running_process);
+    // acknowledge first: the task switched to may not come back through here for a while
+    send_eoi(PIT_IRQ);
+    timer_interrupt();
+}
 
-                asm volatile("movl %0, %%esp;"
-                             "movl %1, %%ebp;"
-                             :
-                             :"r"(next_pcb->esp), "r"(next_pcb->ebp)
-                );
-                int parent_terminal = process_term();
-                int offset;
-                if(parent_terminal == current_terminal)
-                    offset = 0;
-                else
-                    offset = ((parent_terminal + 1) * KiB4);
-                user_video_page_table[0].address = (VIDEO_MEM_ADDRESS + offset) >> 12; // shift by 12 to remove non-address bits
-            }
-        }
-    }
+/* apic_timer_interrupt
+       Input: none
+    Function: Handles local APIC timer interrupts (tickless mode), same work as the PIT's.
+              Called from the APIC_TIMER_HANDLER stub in switch.S
+ */
+void apic_timer_interrupt()
+{
+    apic_eoi();
+    timer_interrupt();
+}
 
-    sti();
-    send_eoi(PIT_IRQ);
-    asm volatile("popal; leave; iret;");
+/* APIC_SPURIOUS_HANDLER
+       Input: none
+    Function: Ignores spurious local APIC interrupts, which must not be acknowledged
+ */
+void APIC_SPURIOUS_HANDLER()
+{
+    asm volatile("leave; iret;");
 }
 
 /* init_idt
@@ -271,13 +239,31 @@ void init_idt() {
     set_interrupt(KEYBOARD_HANDLER, (int)KEYBOARD_IDT); // 0x21 = location in idt for IRQ1
     set_interrupt(RTC_HANDLER, (int)RTC_IDT); // 0x28 = location in idt for IRQ8
     set_interrupt(PIT_HANDLER, (int)PIT_IDT);
-    open_rtc(NULL);
+    set_interrupt(APIC_TIMER_HANDLER, (int)APIC_TIMER_IDT);
+    set_interrupt(APIC_SPURIOUS_HANDLER, (int)APIC_SPURIOUS_IDT);
+    sysenter_init();
+    rtc_init();
 
     enable_irq(KEYB_IRQ);
-    enable_irq(RTC_IRQ);
     enable_irq(PIT_IRQ);
 }
 
+/* sysenter_init
+        INPUT: none
+     FUNCTION: if the cpu has sysenter, points its MSRs at sysenter_entry. SYSENTER_ESP is the
+               address of tss.esp0 rather than a stack, sysenter_entry loads the stack pointer
+               from it so nothing has to be rewritten on a task switch
+ */
+void sysenter_init(void) {
+    sysenter_enabled = 0;
+    if(!(cpuid_edx(CPUID_FEATURES) & CPUID_EDX_SEP))
+        return;
+    wrmsr(IA32_SYSENTER_CS, KERNEL_CS, 0);
+    wrmsr(IA32_SYSENTER_ESP, (uint32_t)&tss.esp0, 0);
+    wrmsr(IA32_SYSENTER_EIP, (uint32_t)sysenter_entry, 0);
+    sysenter_enabled = 1;
+}
+
 /* setup_idt
         INPUT: none
      FUNCTION: set all values of IDT to the EXCEPIGNORE exception (null exception) 
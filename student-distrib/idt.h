@@ -13,6 +13,8 @@
 #include "drivers/rtc.h"
 #include "syshandler.h"
 #include "syscalls.h"
+#include "pit.h"
+#include "apic.h"
 
 #define KEYBOARD_PORT 0x60
 #define SYS_IDT 0x80
@@ -28,9 +30,9 @@
 #define PIT_IRQ 0
 #define PIT_IDT 0x20
 
-#define FIRST_QUANT 2
-#define SECOND_QUANT 4
-#define THIRD_QUANT 6
+#define PF_PRESENT 0x1 // page fault error code: set for protection violations, clear for missing pages
+#define PF_WRITE 0x2 // page fault error code: set if the access was a write
+
 
 volatile int rtc_interrupt_ocurred;
 
@@ -62,7 +64,9 @@ void excep_loop();
 void SYSTEMCALL(); 			// 0x80 System Call Handler
 void KEYBOARD_HANDLER();   	// 0x21 Keyboard Hardware Interrupt Handler
 void RTC_HANDLER();  		// 0x28 Real Time Clock Interrupt Handler
-void PIT_HANDLER();			// 0x20 Real Time Clock Interrupt Handler
+void pit_interrupt();			// 0x20 PIT Interrupt Handler (entered through PIT_HANDLER in switch.S)
+void apic_timer_interrupt();	// 0x40 Local APIC Timer Interrupt Handler (entered through APIC_TIMER_HANDLER)
+void APIC_SPURIOUS_HANDLER();	// 0xFF Local APIC Spurious Interrupt Handler
 /* initializes idt */
 extern void init_idt();
 /* sets all idt values to point to the ignore exception (null exception) */
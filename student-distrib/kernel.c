@@ -13,6 +13,7 @@
 #include "filesystem.h"
 #include "syscalls.h"
 #include "pit.h"
+#include "frame.h"
 
 
 /* Macros. */
@@ -125,6 +126,9 @@ entry (unsigned long magic, unsigned long addr)
 					(unsigned) mmap->length_high,
 					(unsigned) mmap->length_low);
 	}
+
+	/* Hand memory above the kernel to the frame allocator */
+	frame_init(mbi);
 	
 
 	/* Construct an LDT entry in the GDT */
@@ -179,14 +183,20 @@ entry (unsigned long magic, unsigned long addr)
 	/* Initializes IDT, places exception handlers, ...*/
 	init_idt();
 
-	/* Enables PIT */
-	pit_init();
+	/* Compare uncached and cached/write-combined mappings (needs the IDT) */
+	memory_type_benchmark();
+
+	/* Enables the scheduling timer (one-shot local APIC or PIT when tickless) */
+	timer_init();
 
-	// Allow interrutps to be received
-	sti();
+	/* Queue the three terminal shells */
+	sched_init();
+	futex_init();
+	switch_benchmark();
+	process_start_shells();
 
 	//sys_execute((uint8_t*)"shell");
 
-	/* Spin (nicely, so we don't chew up cycles) */
-	asm volatile(".1: hlt; jmp .1;");
+	/* Become the idle task: run the shells, halt (nicely, so we don't chew up cycles) when nothing is runnable */
+	sched_idle();
 }
@@ -0,0 +1,108 @@
+#include "kinfo.h"
+#include "lib.h"
+#include "paging.h"
+#include "syshandler.h"
+
+/* The page itself is kernel data. It fills a whole page so mapping it into user
+ * space exposes nothing else */
+static union {
+	kinfo_t info;
+	uint8_t bytes[KiB4];
+} kinfo_page __attribute__((aligned(KiB4)));
+
+/* kinfo_init
+ *    INPUT: khz - TSC rate in kHz, 0 if there is no TSC
+ * FUNCTION: clears the page and starts the clock at 0. tsc_mult is the ns per cycle in 2^24ths,
+ *           which needs a TSC faster than about 4 MHz to fit in 32 bits. Also tells programs
+ *           whether to use SYSENTER, init_idt has run sysenter_init by now
+ */
+void kinfo_init(uint32_t khz)
+{
+	kinfo_t * info = &kinfo_page.info;
+	memset(&kinfo_page, 0, sizeof(kinfo_page));
+	info->sysenter = sysenter_enabled;
+	if(khz > (uint32_t)((NS_PER_MS << KINFO_TSC_SHIFT) >> 32)) {
+		info->tsc_khz = khz;
+		info->tsc_mult = div64_32(NS_PER_MS << KINFO_TSC_SHIFT, khz);
+		info->tsc_base = rdtsc64();
+	}
+}
+
+/* kinfo_map
+ *    INPUT: pid - process slot whose user page table was just set up
+ * FUNCTION: maps the page read-only at USER_KINFO_ADDRESS
+ */
+void kinfo_map(uint32_t pid)
+{
+	user_map_page_ro(pid, USER_KINFO_ENTRY, (uint32_t)&kinfo_page);
+}
+
+/* kinfo_sync
+ *    INPUT: ticks - timer_ticks after the latest accounting
+ * FUNCTION: if the tick count moved, publishes it and moves the clock base up to now, keeping
+ *           the remainder of the last nanosecond so readers never see the clock go backwards.
+ *           Callers have interrupts off
+ */
+void kinfo_sync(uint32_t ticks)
+{
+	kinfo_t * info = &kinfo_page.info;
+	uint64_t now, scaled;
+	if(info->ticks == ticks)
+		return;
+
+	info->seq++;
+	asm volatile("" : : : "memory");
+	if(info->tsc_mult != 0) {
+		now = rdtsc64();
+		scaled = (now - info->tsc_base) * info->tsc_mult + info->tsc_frac;
+		info->ns_base += scaled >> KINFO_TSC_SHIFT;
+		info->tsc_frac = (uint32_t)scaled & ((1 << KINFO_TSC_SHIFT) - 1);
+		info->tsc_base = now;
+	}
+	else {
+		info->ns_base = ticks * NS_PER_TICK;
+	}
+	info->ticks = ticks;
+	asm volatile("" : : : "memory");
+	info->seq++;
+}
+
+/* kinfo_set_task
+ *    INPUT: pid - process now on the cpu
+ *           terminal - its terminal
+ * FUNCTION: updates the page on a switch, only the process switched to can read it until the next one
+ */
+void kinfo_set_task(uint32_t pid, uint32_t terminal)
+{
+	kinfo_page.info.pid = pid;
+	kinfo_page.info.terminal = terminal;
+}
+
+/* kinfo_set_screen
+ *    INPUT: terminal - terminal switched to
+ * FUNCTION: updates the page when the terminal on screen changes
+ */
+void kinfo_set_screen(uint32_t terminal)
+{
+	kinfo_page.info.screen = terminal;
+}
+
+/* kinfo_clock_ns
+ *    INPUT: none
+ * FUNCTION: reads the clock the same way user programs do, retrying if a tick rebased it meanwhile
+ */
+uint64_t kinfo_clock_ns(void)
+{
+	kinfo_t * info = &kinfo_page.info;
+	uint32_t seq;
+	uint64_t ns;
+	do {
+		seq = info->seq;
+		asm volatile("" : : : "memory");
+		ns = info->ns_base;
+		if(info->tsc_mult != 0)
+			ns += ((rdtsc64() - info->tsc_base) * info->tsc_mult + info->tsc_frac) >> KINFO_TSC_SHIFT;
+		asm volatile("" : : : "memory");
+	} while((seq & 1) || seq != info->seq);
+	return ns;
+}
@@ -0,0 +1,48 @@
+/* kinfo.h - Read-only kernel information page shared with every process
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _kinfo_H
+#define _kinfo_H
+
+#include "types.h"
+
+#define USER_KINFO_ENTRY 1 // user page table entry of the info page, right after the vidmap page
+#define USER_KINFO_ADDRESS 0x08401000 // USER_VIDEO_ADDRESS + USER_KINFO_ENTRY * 4 KB
+#define KINFO_TSC_SHIFT 24 // tsc_mult is ns per cycle scaled by 2^24
+#define NS_PER_MS 1000000ULL
+#define NS_PER_TICK 10000000ULL // 1e9 / DESIRED_FREQ
+
+/* Layout of the page as user programs see it (ece391syscall.h has a copy). The clock is
+ *     ns = ns_base + (((tsc - tsc_base) * tsc_mult + tsc_frac) >> KINFO_TSC_SHIFT)
+ * and the kernel moves the base forward every tick so the product cannot overflow. seq is
+ * odd while the kernel rewrites ticks or the clock base, and readers retry if it changed
+ * under them. Without a usable TSC tsc_mult is 0 and ns_base advances a tick at a time */
+typedef struct kinfo {
+	volatile uint32_t seq;
+	volatile uint32_t ticks; // timer_ticks as of the last timer interrupt or switch
+	volatile uint32_t pid; // process on the cpu, so always the reader's own
+	volatile uint32_t terminal; // terminal (root shell pid) of the process on the cpu
+	volatile uint32_t screen; // terminal on screen
+	uint32_t tsc_khz; // TSC rate measured at boot, 0 if there is none
+	uint32_t tsc_mult;
+	volatile uint32_t tsc_frac; // sub-nanosecond remainder at tsc_base, scaled like tsc_mult
+	volatile uint64_t tsc_base;
+	volatile uint64_t ns_base;
+	uint32_t sysenter; // 1 if system calls may use SYSENTER (sysenter_init set up the MSRs)
+} kinfo_t;
+
+/* clear the page, publish sysenter_enabled and set up the clock for a TSC running at 'khz' (0 = no TSC) */
+void kinfo_init(uint32_t khz);
+/* map the page read-only into a new process's user page table */
+void kinfo_map(uint32_t pid);
+/* bring the tick count and clock base up to 'ticks', called as time is accounted */
+void kinfo_sync(uint32_t ticks);
+/* record the process now on the cpu */
+void kinfo_set_task(uint32_t pid, uint32_t terminal);
+/* record the terminal now on screen */
+void kinfo_set_screen(uint32_t terminal);
+/* nanoseconds since boot, the same clock user programs read from the page */
+uint64_t kinfo_clock_ns(void);
+
+#endif /* _kinfo_H */
@@ -340,14 +340,11 @@ putc_input(uint8_t c)
  */
 int32_t process_term(void)
 {
-	PCB * pcb = (PCB*)(_8MB - _8KB * (running_process + 1) );
-	int32_t term = pcb->p_id;
-	while(pcb->p_id > 2){
-		pcb = (PCB*)(_8MB - _8KB * (pcb->parent + 1) );
-		term = pcb->p_id;
-	}
-
-	return term;
+	PCB * pcb = get_pcb_by_pid(running_process);
+	if(pcb == NULL)
+		return 0; // no process yet (boot messages), use the first terminal
+	// set from the parent when the process was created, so orphans (parent -1) still know theirs
+	return pcb->terminal;
 }
 
 /*
@@ -77,6 +77,68 @@ static inline uint32_t inl(port)
 	return val;
 }
 
+/* Reads the low 32 bits of the time stamp counter (enough for deltas under a second or so) */
+static inline uint32_t rdtsc(void)
+{
+	uint32_t low, high;
+	asm volatile("rdtsc"
+			: "=a"(low), "=d"(high)
+			:
+			: "memory" );
+	return low;
+}
+
+/* Reads the whole 64-bit time stamp counter */
+static inline uint64_t rdtsc64(void)
+{
+	uint32_t low, high;
+	asm volatile("rdtsc"
+			: "=a"(low), "=d"(high)
+			:
+			: "memory" );
+	return ((uint64_t)high << 32) | low;
+}
+
+/* Divides "n" by "d" with a single divl (there is no libgcc for 64-bit division).
+ * The quotient must fit in 32 bits, that is (n >> 32) < d */
+static inline uint32_t div64_32(uint64_t n, uint32_t d)
+{
+	uint32_t q, r;
+	asm("divl %4"
+			: "=a"(q), "=d"(r)
+			: "a"((uint32_t)n), "d"((uint32_t)(n >> 32)), "rm"(d) );
+	return q;
+}
+
+/* Returns the EDX feature flags of cpuid leaf "leaf" */
+static inline uint32_t cpuid_edx(uint32_t leaf)
+{
+	uint32_t a, b, c, d;
+	asm volatile("cpuid"
+			: "=a"(a), "=b"(b), "=c"(c), "=d"(d)
+			: "a"(leaf)
+			: "memory" );
+	return d;
+}
+
+/* Reads model specific register "msr" into "low" and "high" */
+#define rdmsr(msr, low, high)           \
+do {                                    \
+	asm volatile("rdmsr"                \
+			: "=a" (low), "=d" (high)   \
+			: "c" (msr)                 \
+			: "memory" );               \
+} while(0)
+
+/* Writes "low" and "high" to model specific register "msr" */
+#define wrmsr(msr, low, high)           \
+do {                                    \
+	asm volatile("wrmsr"                \
+			:                           \
+			: "c" (msr), "a" (low), "d" (high) \
+			: "memory" );               \
+} while(0)
+
 /* Writes a byte to a port */
 #define outb(data, port)                \
 do {                                    \
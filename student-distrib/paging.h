@@ -9,10 +9,31 @@
 #define VIDEO_MEM_ADDRESS 0xB8000
 #define VIDEO_MEM_LOCATION VIDEO_MEM_ADDRESS / 0x1000
 #define KERNEL_ADDRESS 0x400000
+#define PAGE_4MB 0x400000
 #define FIRST_PROGRAM_VIRTUAL  0x08000000
 #define USER_VIDEO_ADDRESS 0x08400000 // can be located anywher >= 132 MB
 #define USER_VIDEO_LOCATION USER_VIDEO_ADDRESS / 0x400000
 #define FIRST_PROGRAM_LOCATION FIRST_PROGRAM_VIRTUAL / 0x400000
+#define USER_VIDEO_ENTRY 0 // entry of the vidmap page in a process's user page table
+#define USER_MMAP_FIRST_ENTRY 16 // first user page table entry handed out by mmap
+#define USER_MMAP_ADDRESS (USER_VIDEO_ADDRESS + USER_MMAP_FIRST_ENTRY * KiB4)
+#define NUM_USER_PAGE_TABLES 32 // one per process slot (MAX_NUM_PROCESSES)
+#define DIRECT_MAP_FIRST_LOCATION 2 // 8 MB, first 4 MB page of the kernel's direct map of frame memory
+#define PTE_AVAIL_FRAME 0x1 // avail bits of a page table entry: page owns an allocator frame
+#define PTE_AVAIL_COW 0x2 // avail bits: frame shared with a forked process, read-only until written
+#define NUM_VIDEO_PAGES 4 // VGA text memory plus one backing page per terminal
+
+// memory types, as the PAT index picked by a page's PWT (bit 0) and PCD (bit 1) flags
+#define MEM_TYPE_WB 0 // write-back: PAT entry 0, the power-on default
+#define MEM_TYPE_WC 1 // write-combining: PAT entry 1, reprogrammed from write-through by pat_init
+#define MEM_TYPE_UC 3 // uncacheable: PAT entry 3
+#define IA32_PAT_MSR 0x277
+#define PAT_ENTRY1_SHIFT 8
+#define PAT_TYPE_WC 0x01
+#define CPUID_FEATURES 1
+#define CPUID_EDX_PAT (1 << 16)
+#define MEMTYPE_BENCH_ROUNDS 64
+#define MEMTYPE_BENCH_SYSCALL 13 // clock_gettime, with a bad clock id it returns right after dispatch
 
 // Sturcutre for page directory entires
 typedef union page_directory_desc_t {
@@ -51,12 +72,32 @@ typedef union page_table_desc_t {
 } page_table_desc_t;
 /* Initialize paging */
 extern void paging_init(void);
-extern void program_paging(uint32_t physical_address);
+extern void program_paging(uint32_t pid);
+extern int32_t process_paging_alloc(uint32_t pid);
+extern void process_paging_free(uint32_t pid);
+extern int32_t process_paging_fork(uint32_t parent, uint32_t child);
+extern void program_map_page_ro(uint32_t pid, uint32_t entry, uint32_t physical_address);
 extern void swap_terminal_mapping(int new_terminal);
 extern void user_mapping(void);
+extern void user_page_table_init(uint32_t pid);
+extern void user_map_page_ro(uint32_t pid, uint32_t entry, uint32_t physical_address);
+extern void flush_tlb(void);
+extern void pte_set_memory_type(page_table_desc_t * pte, uint32_t type);
+extern void pde_set_memory_type(page_directory_desc_t * pde, uint32_t type);
+extern void memory_type_benchmark(void);
+extern uint32_t paging_map_mmio(uint32_t physical_address);
+extern void invlpg(uint32_t address);
+extern uint32_t get_cr3(void);
+extern void load_cr3(uint32_t directory);
 
-// Directory and table declaration
+// Directory and table declaration (page_directory is the kernel's, every process directory starts as a copy)
 page_directory_desc_t page_directory[NUM_PAGE_DIRECTORY_ENTRIES] __attribute__((aligned(KiB4)));
 page_table_desc_t page_table[NUM_PAGE_TABLE_ENTRIES] __attribute__((aligned(KiB4)));
-page_table_desc_t user_video_page_table[NUM_PAGE_TABLE_ENTRIES] __attribute__((aligned(KiB4)));
+// per-process page directories, kernel entries copied from page_directory
+page_directory_desc_t* process_directory[NUM_USER_PAGE_TABLES];
+// per-process 4 KB page tables for the 4 MB program page, filled in on demand by the page fault handler
+// (tables live in allocator frames, which the kernel reaches through its direct map)
+page_table_desc_t* program_page_table[NUM_USER_PAGE_TABLES];
+// per-process 4 KB page tables for the 4 MB region at USER_VIDEO_ADDRESS (vidmap page + mmap pages)
+page_table_desc_t* user_page_table[NUM_USER_PAGE_TABLES];
 #endif /* _paging_H */
@@ -1,4 +1,20 @@
 #include "pit.h"
+#include "apic.h"
+#include "kinfo.h"
+
+/* Time is kept in units of the timer hardware's counter. In tickless mode the
+ * timer is programmed for exactly the next thing that needs the cpu: the end of
+ * the running task's quantum or the first kernel timer, or TIMER_IDLE_TICKS from
+ * now if there is neither. Whenever
+ * the kernel looks at the clock the units counted so far are folded in and every
+ * whole 10 ms tick advances timer_ticks, so tick accounting is the same as with
+ * a fixed 100 Hz interrupt. */
+static uint32_t units_per_tick; // counter units in one 10 ms tick
+static uint32_t clock_units; // counter units elapsed as of the last timer_sync
+static uint32_t tick_units; // clock_units at the last whole tick
+static uint32_t armed_units; // units left on the one-shot when timer_sync last looked
+static uint32_t quantum_end; // clock_units at which the running task's quantum expires
+static ktimer_t * timer_list; // pending kernel timers, earliest first
 
 /* pit_init
  *    INPUT: none
@@ -12,3 +28,341 @@ pit_init(void)
 	outb(divisor & 0xFF, DATAPORT0); //0xFF = low byte masking
 	outb(divisor >> 8, DATAPORT0); // >> 8 = high byte masking
 }
+
+/* pit_oneshot
+ *    INPUT: count - PIT input clocks until the interrupt
+ * FUNCTION: starts channel 0 counting down once, its irq fires when it reaches 0
+ */
+static void pit_oneshot(uint32_t count)
+{
+	outb(ONESHOT_COMMAND, COMMAND_REG);
+	outb(count & 0xFF, DATAPORT0); //0xFF = low byte masking
+	outb(count >> 8, DATAPORT0); // >> 8 = high byte masking
+}
+
+/* pit_remaining
+ *    INPUT: none
+ * FUNCTION: returns the input clocks left on channel 0's one-shot. The status byte says whether
+ *           the count has already expired or has not been loaded yet
+ */
+static uint32_t pit_remaining(void)
+{
+	uint32_t status, low;
+	outb(STATUS_COMMAND, COMMAND_REG);
+	status = inb(DATAPORT0);
+	if(status & STATUS_OUT)
+		return 0;
+	if(status & STATUS_NULL_COUNT)
+		return armed_units;
+	outb(LATCH_COMMAND, COMMAND_REG);
+	low = inb(DATAPORT0);
+	return low | (inb(DATAPORT0) << 8); // << 8 = high byte
+}
+
+/* pit_channel2_load
+ *    INPUT: count - PIT input clocks to time
+ * FUNCTION: loads 'count' into PIT channel 2 with its gate held low and returns the port B value
+ *           that holds it. Raising PORT_B_GATE2 starts the count and PORT_B_OUT2 goes high at 0,
+ *           which can be polled with interrupts off
+ */
+static uint32_t pit_channel2_load(uint32_t count)
+{
+	uint32_t port_b = inb(PORT_B) & ~(PORT_B_GATE2 | PORT_B_SPEAKER);
+
+	outb(port_b, PORT_B); // gate low holds channel 2
+	outb(CALIBRATE_COMMAND, COMMAND_REG);
+	outb(count & 0xFF, DATAPORT2); //0xFF = low byte masking
+	outb(count >> 8, DATAPORT2); // >> 8 = high byte masking
+	return port_b;
+}
+
+/* apic_calibrate
+ *    INPUT: none
+ * FUNCTION: measures how many APIC timer units pass in one tick by timing a tick's worth of
+ *           PIT channel 2 (polled, so no interrupts are needed)
+ */
+static uint32_t apic_calibrate(void)
+{
+	uint32_t port_b = pit_channel2_load(PIT_FREQ / DESIRED_FREQ);
+	uint32_t count;
+
+	apic_timer_oneshot(0xFFFFFFFF);
+	outb(port_b | PORT_B_GATE2, PORT_B); // rising gate starts the count
+	while(!(inb(PORT_B) & PORT_B_OUT2));
+	count = 0xFFFFFFFF - apic_timer_current();
+	outb(port_b, PORT_B);
+	return count;
+}
+
+/* tsc_calibrate
+ *    INPUT: none
+ * FUNCTION: times the longest count PIT channel 2 can do (~55 ms) with the TSC and returns the
+ *           TSC rate in kHz, or 0 if the cpu has no TSC
+ */
+static uint32_t tsc_calibrate(void)
+{
+	uint32_t port_b, start, cycles;
+	if(!(cpuid_edx(CPUID_FEATURES) & CPUID_EDX_TSC))
+		return 0;
+
+	port_b = pit_channel2_load(PIT_MAX_COUNT);
+	start = rdtsc();
+	outb(port_b | PORT_B_GATE2, PORT_B); // rising gate starts the count
+	while(!(inb(PORT_B) & PORT_B_OUT2));
+	cycles = rdtsc() - start;
+	outb(port_b, PORT_B);
+	// cycles per PIT_MAX_COUNT input clocks, PIT_FREQ input clocks a second
+	return div64_32((uint64_t)cycles * PIT_FREQ, PIT_MAX_COUNT * 1000);
+}
+
+/* timer_init
+ *    INPUT: none
+ * FUNCTION: chooses the scheduling timer. Tickless mode prefers the local APIC timer (calibrated
+ *           against the PIT, PIT irq masked) and falls back to the PIT in one-shot mode. Without
+ *           TIMER_TICKLESS the PIT interrupts at a fixed 100 Hz as before
+ */
+void timer_init(void)
+{
+	uint32_t flags;
+	clock_units = 0;
+	tick_units = 0;
+	armed_units = 0;
+	timer_interrupts = 0;
+	timer_list = NULL;
+
+	cli_and_save(flags);
+	tsc_khz = tsc_calibrate();
+	kinfo_init(tsc_khz);
+	restore_flags(flags);
+	printf("timer: TSC at %d kHz\n", tsc_khz);
+
+	if(!TIMER_TICKLESS) {
+		units_per_tick = PIT_FREQ / DESIRED_FREQ;
+		timer_mode = TIMER_PERIODIC;
+		pit_init();
+		printf("timer: PIT at %d Hz\n", DESIRED_FREQ);
+		return;
+	}
+
+	cli_and_save(flags);
+	if(apic_init() == 0) {
+		units_per_tick = apic_calibrate();
+		disable_irq(PIT_IRQ);
+		timer_mode = TIMER_APIC_ONESHOT;
+		printf("timer: local APIC one-shot, %d units per tick\n", units_per_tick);
+	}
+	else {
+		units_per_tick = PIT_FREQ / DESIRED_FREQ;
+		timer_mode = TIMER_PIT_ONESHOT;
+		printf("timer: PIT one-shot\n");
+	}
+	timer_quantum_start(); // no task yet, so this arms the idle timeout
+	restore_flags(flags);
+}
+
+/* timer_account
+ *    INPUT: none
+ * FUNCTION: turns whole ticks of clock_units into timer_ticks, charging each to the task on the cpu,
+ *           and publishes the new count on the info page
+ */
+static void timer_account(void)
+{
+	while(clock_units - tick_units >= units_per_tick) {
+		tick_units += units_per_tick;
+		timer_ticks++;
+		if(sched_current != NULL) {
+			sched_current->run_ticks++; // charge the tick to whoever it interrupted
+			if(sched_current->in_kernel)
+				sched_current->kernel_ticks++;
+			else
+				sched_current->user_ticks++;
+		}
+		else {
+			sched_idle_ticks++;
+		}
+	}
+	kinfo_sync(timer_ticks);
+}
+
+/* timer_sync
+ *    INPUT: none
+ * FUNCTION: adds the units the one-shot counted since the last look to the clock. Nothing to do
+ *           for the periodic timer, whose interrupts each count one tick
+ */
+void timer_sync(void)
+{
+	uint32_t left;
+	uint32_t flags;
+	if(timer_mode != TIMER_PIT_ONESHOT && timer_mode != TIMER_APIC_ONESHOT)
+		return;
+
+	cli_and_save(flags);
+	left = (timer_mode == TIMER_APIC_ONESHOT) ? apic_timer_current() : pit_remaining();
+	if(left > armed_units)
+		left = armed_units;
+	clock_units += armed_units - left;
+	armed_units = left;
+	timer_account();
+	restore_flags(flags);
+}
+
+/* timer_arm
+ *    INPUT: none
+ * FUNCTION: programs the one-shot for the earliest deadline: the running task's quantum end or
+ *           the first kernel timer, or TIMER_IDLE_TICKS from now if there is neither, clipped
+ *           to what the counter can hold
+ */
+static void timer_arm(void)
+{
+	int32_t left;
+	int32_t delta = TIMER_IDLE_TICKS * units_per_tick;
+	int32_t min_delta = (units_per_tick >> 6) + 1; // ~150 us, shorter would only cost another interrupt
+
+	if(sched_current != NULL) {
+		left = quantum_end - clock_units;
+		if(left < delta)
+			delta = left;
+	}
+	if(timer_list != NULL) {
+		left = timer_list->expires - clock_units;
+		if(left < delta)
+			delta = left;
+	}
+	if(delta < min_delta)
+		delta = min_delta;
+	if(timer_mode == TIMER_PIT_ONESHOT) {
+		if(delta > PIT_MAX_COUNT)
+			delta = PIT_MAX_COUNT;
+		pit_oneshot(delta);
+	}
+	else {
+		apic_timer_oneshot(delta);
+	}
+	armed_units = delta;
+}
+
+/* timer_expire
+ *    INPUT: none
+ * FUNCTION: fires every kernel timer whose time has come, waking its sleepers
+ */
+static void timer_expire(void)
+{
+	ktimer_t * timer;
+	while(timer_list != NULL && (int32_t)(clock_units - timer_list->expires) >= 0) {
+		timer = timer_list;
+		timer_list = timer->next;
+		timer->next = NULL;
+		timer->fired = 1;
+		wake_up(&timer->wait);
+	}
+}
+
+/* timer_init_one
+ *    INPUT: timer - timer to set up
+ * FUNCTION: leaves the timer idle with an empty wait queue
+ */
+void timer_init_one(ktimer_t * timer)
+{
+	timer->next = NULL;
+	timer->expires = 0;
+	timer->fired = 0;
+	wait_queue_init(&timer->wait);
+}
+
+/* timer_del
+ *    INPUT: timer - timer that may be pending
+ * FUNCTION: unlinks the timer if it is still on the list
+ */
+void timer_del(ktimer_t * timer)
+{
+	ktimer_t ** link;
+	uint32_t flags;
+	cli_and_save(flags);
+	for(link = &timer_list; *link != NULL; link = &(*link)->next) {
+		if(*link == timer) {
+			*link = timer->next;
+			timer->next = NULL;
+			break;
+		}
+	}
+	restore_flags(flags);
+}
+
+/* timer_add
+ *    INPUT: timer - timer from timer_init_one
+ *           ns - nanoseconds until it fires
+ * FUNCTION: converts 'ns' to clock units (rounding up, and no further ahead than TIMER_IDLE_TICKS
+ *           so the signed comparisons hold), puts the timer in its place on the list and rearms
+ *           the one-shot in case it is now the earliest deadline. With the periodic timer it
+ *           fires on the first tick at or after its time
+ */
+void timer_add(ktimer_t * timer, uint64_t ns)
+{
+	ktimer_t ** link;
+	uint32_t flags;
+
+	timer_del(timer);
+	if(ns > TIMER_IDLE_TICKS * NS_PER_TICK)
+		ns = TIMER_IDLE_TICKS * NS_PER_TICK;
+
+	cli_and_save(flags);
+	timer_sync();
+	timer->fired = 0;
+	timer->expires = clock_units + div64_32(ns * units_per_tick + NS_PER_TICK - 1, NS_PER_TICK);
+	for(link = &timer_list; *link != NULL; link = &(*link)->next) {
+		if((int32_t)(timer->expires - (*link)->expires) < 0)
+			break;
+	}
+	timer->next = *link;
+	*link = timer;
+	if(timer_mode == TIMER_PIT_ONESHOT || timer_mode == TIMER_APIC_ONESHOT)
+		timer_arm();
+	restore_flags(flags);
+}
+
+/* timer_quantum_start
+ *    INPUT: none
+ * FUNCTION: gives the task now on the cpu a new quantum (as long as its policy allows), timed from
+ *           now, and arms the timer for it. Called by the scheduler on every switch
+ */
+void timer_quantum_start(void)
+{
+	uint32_t flags;
+	if(timer_mode == TIMER_OFF)
+		return;
+	cli_and_save(flags);
+	if(sched_current != NULL)
+		quantum_end = clock_units + sched_quantum(sched_current) * units_per_tick;
+	if(timer_mode != TIMER_PERIODIC)
+		timer_arm();
+	restore_flags(flags);
+}
+
+/* timer_interrupt
+ *    INPUT: none
+ * FUNCTION: updates the clock, fires expired kernel timers and preempts the running task if its
+ *           quantum is used up, or else arms the timer again (a switch arms it for the next task).
+ *           The caller has already acknowledged the interrupt, since the task switched to may not
+ *           return here for a while
+ */
+void timer_interrupt(void)
+{
+	timer_interrupts++;
+	if(timer_mode == TIMER_PERIODIC) {
+		clock_units += units_per_tick;
+		timer_account();
+	}
+	else {
+		timer_sync();
+	}
+	timer_expire();
+
+	if(sched_current != NULL && (int32_t)(clock_units - quantum_end) >= 0)
+		schedule();
+	else if(timer_mode != TIMER_PERIODIC)
+		timer_arm();
+
+	// a thread interrupted in user space whose process has exited halts here
+	if(sched_current != NULL && !sched_current->in_kernel)
+		process_exit_pending();
+}
@@ -9,9 +9,58 @@
 #define DESIRED_FREQ 100
 #define COMMAND_REG 0x43
 #define DATAPORT0 0x40
+#define DATAPORT2 0x42
 #define IOCOMMAND 0x36 // channel 0, access mode: lobyte/hibyte, square wave generator, 16b binary
+#define ONESHOT_COMMAND 0x30 // channel 0, access mode: lobyte/hibyte, interrupt on terminal count, 16b binary
+#define STATUS_COMMAND 0xE2 // read-back: status (not count) of channel 0
+#define LATCH_COMMAND 0x00 // latch channel 0's count
+#define CALIBRATE_COMMAND 0xB0 // channel 2, access mode: lobyte/hibyte, interrupt on terminal count
+#define STATUS_OUT 0x80 // output pin high: a one-shot count reached 0
+#define STATUS_NULL_COUNT 0x40 // count written but not loaded yet
+#define PIT_MAX_COUNT 0xFFFF
+#define PORT_B 0x61 // bit 0 gates channel 2, bit 1 drives the speaker, bit 5 reads channel 2's output
+#define PORT_B_GATE2 0x01
+#define PORT_B_SPEAKER 0x02
+#define PORT_B_OUT2 0x20
+#define CPUID_EDX_TSC (1 << 4)
 
+#define TIMER_TICKLESS 1 // 0 keeps the fixed 100 Hz PIT interrupt
+#define TIMER_IDLE_TICKS 100 // longest sleep when nothing has a deadline, keeps timer_ticks moving
 
+// source of the scheduling interrupt
+#define TIMER_OFF 0
+#define TIMER_PERIODIC 1 // PIT square wave at DESIRED_FREQ
+#define TIMER_PIT_ONESHOT 2
+#define TIMER_APIC_ONESHOT 3
+
+/* One-shot kernel timer, kept on a list sorted by expiry. Whoever arms it sleeps on 'wait'
+ * until 'fired' is set; the timer may live on the sleeper's kernel stack */
+typedef struct ktimer {
+	struct ktimer * next;
+	uint32_t expires; // clock units at which it fires
+	uint32_t fired;
+	wait_queue_t wait;
+} ktimer_t;
+
+/* set the fixed 100 Hz PIT rate */
 void pit_init(void);
+/* pick the scheduling timer: local APIC or PIT in one-shot mode if TIMER_TICKLESS, else the fixed PIT rate */
+void timer_init(void);
+/* body of the PIT and APIC timer interrupts: advances time, preempts an expired quantum, arms the next interrupt */
+void timer_interrupt(void);
+/* bring timer_ticks up to date and charge the elapsed ticks to the task on the cpu */
+void timer_sync(void);
+/* start a full quantum for the task now on the cpu (nothing if idle) and arm the timer for it */
+void timer_quantum_start(void);
+/* prepare a kernel timer for timer_add */
+void timer_init_one(ktimer_t * timer);
+/* fire 'timer' about 'ns' nanoseconds from now (at most TIMER_IDLE_TICKS ahead), rearms it if pending */
+void timer_add(ktimer_t * timer, uint64_t ns);
+/* take 'timer' off the list if it has not fired */
+void timer_del(ktimer_t * timer);
+
+uint32_t timer_mode; // TIMER_*
+uint32_t timer_interrupts; // scheduling timer interrupts taken (compare with timer_ticks)
+uint32_t tsc_khz; // TSC rate measured against the PIT at boot, 0 without a TSC
 
 #endif
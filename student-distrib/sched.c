@@ -0,0 +1,458 @@
+#include "sched.h"
+#include "syscalls.h"
+#include "pit.h"
+
+/* Runnable tasks that are not on the cpu live on the queues of the current
+ * policy (see sched_policy.c), reached through its jump table. sched.c only
+ * counts them, so the idle task can tell whether anything is waiting. */
+static uint32_t * policy;
+static uint32_t nr_queued; // runnable tasks on the policy's queues
+static cpu_context_t idle_context; // save area for the idle task (the boot context), which has no PCB
+static cpu_context_t bench_main, bench_peer; // the two sides of switch_benchmark
+
+/* task_of
+ *    INPUT: node - link inside a PCB
+ * FUNCTION: returns the PCB that holds 'node'
+ */
+PCB * task_of(sched_node_t * node)
+{
+	return (PCB *)((uint8_t *)node - (uint32_t)&((PCB *)0)->node);
+}
+
+/* list_add_tail
+ *    INPUT: head - list sentinel
+ *           node - link to append, must be on no list
+ * FUNCTION: appends 'node' to the end of the list
+ */
+void list_add_tail(sched_node_t * head, sched_node_t * node)
+{
+	node->prev = head->prev;
+	node->next = head;
+	head->prev->next = node;
+	head->prev = node;
+}
+
+/* list_del
+ *    INPUT: node - link to unlink
+ * FUNCTION: removes 'node' from whatever list it is on (does nothing if it is on none)
+ */
+void list_del(sched_node_t * node)
+{
+	if(node->next == NULL)
+		return;
+	node->prev->next = node->next;
+	node->next->prev = node->prev;
+	node->next = NULL;
+	node->prev = NULL;
+}
+
+/* list_pop
+ *    INPUT: head - list sentinel
+ * FUNCTION: unlinks and returns the task at the front of the list, NULL if it is empty
+ */
+PCB * list_pop(sched_node_t * head)
+{
+	sched_node_t * node = head->next;
+	if(node == head)
+		return NULL;
+	list_del(node);
+	return task_of(node);
+}
+
+/* list_init
+ *    INPUT: head - list sentinel
+ * FUNCTION: makes the list empty
+ */
+void list_init(sched_node_t * head)
+{
+	head->next = head;
+	head->prev = head;
+}
+
+/* runq_add
+ *    INPUT: task - runnable task that is on no list
+ *           reason - SCHED_NEW, SCHED_PREEMPTED, SCHED_WOKEN or SCHED_YIELD
+ * FUNCTION: hands 'task' to the policy, which decides where it waits. Interrupts must be off
+ */
+static void runq_add(PCB * task, uint32_t reason)
+{
+	void (*enqueue)(PCB * task, uint32_t reason) = (void*)policy[POLICY_OP_ENQUEUE];
+	task->state = TASK_RUNNABLE;
+	enqueue(task, reason);
+	nr_queued++;
+}
+
+/* runq_pick
+ *    INPUT: none
+ * FUNCTION: takes the task the policy wants to run next off its queues, NULL if none is waiting.
+ *           Interrupts must be off
+ */
+static PCB * runq_pick(void)
+{
+	PCB * (*pick)(void) = (void*)policy[POLICY_OP_PICK];
+	PCB * task = pick();
+	if(task != NULL)
+		nr_queued--;
+	return task;
+}
+
+/* sched_init
+ *    INPUT: none
+ * FUNCTION: starts the default policy with empty queues, no task is current until the first switch
+ */
+void sched_init(void)
+{
+	void (*init)(void);
+	policy = sched_policies[SCHED_DEFAULT_POLICY];
+	sched_policy = SCHED_DEFAULT_POLICY;
+	init = (void*)policy[POLICY_OP_INIT];
+	init();
+	nr_queued = 0;
+	idle_context.esp0 = tss.esp0; // the boot stack, idle never leaves ring 0 so it is never used
+	sched_current = NULL;
+	sched_idle_ticks = 0;
+	sched_idle_entries = 0;
+}
+
+/* sched_set_policy
+ *    INPUT: which - SCHED_POLICY_RR or SCHED_POLICY_MLFQ
+ * FUNCTION: switches scheduling policy, moving every queued task over in the order the old policy
+ *           would have run them. Returns 0, or -1 for an unknown policy
+ */
+int32_t sched_set_policy(uint32_t which)
+{
+	sched_node_t moving;
+	PCB * task;
+	void (*init)(void);
+	uint32_t flags;
+	if(which >= NUM_SCHED_POLICIES)
+		return -1;
+
+	cli_and_save(flags);
+	list_init(&moving);
+	while((task = runq_pick()) != NULL)
+		list_add_tail(&moving, &task->node);
+	policy = sched_policies[which];
+	sched_policy = which;
+	init = (void*)policy[POLICY_OP_INIT];
+	init();
+	while((task = list_pop(&moving)) != NULL)
+		runq_add(task, SCHED_YIELD);
+	restore_flags(flags);
+	return 0;
+}
+
+/* sched_quantum
+ *    INPUT: task - task being switched in
+ * FUNCTION: returns the number of ticks the policy lets 'task' run before preempting it
+ */
+uint32_t sched_quantum(PCB * task)
+{
+	uint32_t (*quantum)(PCB * task) = (void*)policy[POLICY_OP_QUANTUM];
+	return quantum(task);
+}
+
+/* wait_queue_init
+ *    INPUT: queue - wait queue to set up
+ * FUNCTION: makes 'queue' an empty list
+ */
+void wait_queue_init(wait_queue_t * queue)
+{
+	list_init(&queue->head);
+}
+
+/* sched_enqueue
+ *    INPUT: task - new task to make runnable
+ * FUNCTION: marks 'task' runnable and queues it (unless it is already queued)
+ */
+void sched_enqueue(PCB * task)
+{
+	uint32_t flags;
+	cli_and_save(flags);
+	if(task->node.next == NULL)
+		runq_add(task, SCHED_NEW);
+	restore_flags(flags);
+}
+
+/* switch_mm
+ *    INPUT: next - task about to run
+ * FUNCTION: loads the address space and kernel stack of 'next' and points its vidmap page at
+ *           the screen if its terminal is showing, or at the terminal's backing page otherwise
+ */
+static void switch_mm(PCB * next)
+{
+	int parent_terminal, offset;
+
+	sched_current = next;
+	running_process = next->p_id;
+	program_paging(next->group);     // change to next processes page (switch_to loads tss.esp0), threads share it
+
+	parent_terminal = process_term();
+	if(parent_terminal == current_terminal)
+		offset = 0;
+	else
+		offset = ((parent_terminal + 1) * KiB4);
+	user_page_table[next->group][USER_VIDEO_ENTRY].address = (VIDEO_MEM_ADDRESS + offset) >> 12; // shift by 12 to remove non-address bits
+	invlpg(USER_VIDEO_ADDRESS);
+	kinfo_set_task(next->p_id, next->terminal);
+}
+
+/* context_switch
+ *    INPUT: prev - task giving up the cpu (NULL for the idle task)
+ *           next - task to run (NULL for the idle task)
+ * FUNCTION: does the bookkeeping of a switch (clock, counters, address space) and hands the
+ *           registers over to switch_to. A task switched out here returns from switch_to when it
+ *           is next picked; a new task's context (see sched_prepare_task) starts in task_start
+ */
+void context_switch(PCB * prev, PCB * next)
+{
+	cpu_context_t * from = (prev != NULL) ? &prev->context : &idle_context;
+	cpu_context_t * to = (next != NULL) ? &next->context : &idle_context;
+
+	timer_sync(); // charge the time so far to prev
+	if(prev != NULL) {
+		if(prev->state == TASK_RUNNABLE)
+			prev->nivcsw++; // preempted
+		else
+			prev->nvcsw++; // blocked or halted
+	}
+	if(next != NULL)
+		switch_mm(next);
+	else
+		sched_current = NULL; // idle keeps whichever directory is loaded, it only touches kernel memory
+	timer_quantum_start();
+	switch_to(from, to);
+}
+
+/* schedule
+ *    INPUT: none
+ * FUNCTION: requeues the current task if it is still runnable (it is being preempted, everything
+ *           else that gives up the cpu blocks first) and switches to the task the policy picks,
+ *           or to the idle task if nothing can run
+ */
+void schedule(void)
+{
+	PCB * prev = sched_current;
+	PCB * next;
+	uint32_t flags;
+
+	cli_and_save(flags);
+	if(prev != NULL && prev->state == TASK_RUNNABLE && prev->node.next == NULL)
+		runq_add(prev, SCHED_PREEMPTED);
+	next = runq_pick();
+	if(next != prev) {
+		context_switch(prev, next);
+	}
+	else if(prev != NULL) {
+		timer_sync();
+		timer_quantum_start(); // nothing else wants the cpu, prev gets another quantum
+	}
+	restore_flags(flags);
+}
+
+/* sched_idle
+ *    INPUT: none
+ * FUNCTION: body of the idle task, which the boot context becomes once the shells are queued.
+ *           Runs whatever is runnable and otherwise halts until an interrupt. A wake up from an
+ *           interrupt handler is picked up as soon as that handler returns, not at the next
+ *           quantum. Never returns
+ */
+void sched_idle(void)
+{
+	for(;;) {
+		cli();
+		if(nr_queued != 0) {
+			schedule();
+			continue;
+		}
+		sched_idle_entries++;
+		asm volatile("sti; hlt;" : : : "memory"); // sti holds off interrupts until hlt has started
+	}
+}
+
+/* sched_run
+ *    INPUT: next - task to run now
+ * FUNCTION: switches straight to 'next' without going through the run queue. The current task
+ *           is requeued only if it is still runnable (a parent starting a child blocks first)
+ */
+void sched_run(PCB * next)
+{
+	PCB * prev = sched_current;
+	uint32_t flags;
+
+	cli_and_save(flags);
+	if(next->node.next != NULL) {
+		if(next->state == TASK_RUNNABLE)
+			nr_queued--; // taken off the policy's queues, not a wait queue
+		list_del(&next->node);
+	}
+	next->state = TASK_RUNNABLE;
+	if(prev != NULL && prev->state == TASK_RUNNABLE && prev->node.next == NULL)
+		runq_add(prev, SCHED_YIELD);
+	if(next != prev)
+		context_switch(prev, next);
+	restore_flags(flags);
+}
+
+/* sched_restart
+ *    INPUT: task - task whose kernel stack was just prepared by sched_prepare_task
+ * FUNCTION: drops the current kernel context and enters 'task' from its fresh frame. Used when a
+ *           root shell halts and a new shell takes over its slot (and the stack we are running on)
+ */
+void sched_restart(PCB * task)
+{
+	static cpu_context_t discard; // the old context is never resumed
+	cli();
+	switch_mm(task);
+	switch_to(&discard, &task->context);
+}
+
+/* sched_prepare_context
+ *    INPUT: task - new task
+ *           sp - kernel stack pointer it starts with
+ *           eip - kernel code it starts in
+ * FUNCTION: fills in the saved context the first switch to 'task' loads
+ */
+static void sched_prepare_context(PCB * task, uint32_t sp, uint32_t eip)
+{
+	task->context.esp = sp;
+	task->context.ebp = 0;
+	task->context.ebx = 0;
+	task->context.esi = 0;
+	task->context.edi = 0;
+	task->context.eip = eip;
+	task->context.eflags = KERNEL_EFLAGS;
+	task->context.esp0 = (uint32_t)task + _8KB;
+	task->context.fs = KERNEL_DS;
+	task->context.gs = KERNEL_DS;
+	task->node.next = NULL;
+	task->node.prev = NULL;
+	task->state = TASK_RUNNABLE;
+}
+
+/* sched_prepare_task
+ *    INPUT: task - new task, its PCB already filled in
+ *           entry_point - user address to start at
+ *           user_stack - user stack pointer to start with (USER_STACK_TOP for a program)
+ * FUNCTION: builds an iret frame for the entry point at the top of the task's kernel stack and
+ *           a saved context that resumes in task_start with the stack pointing at it. Only the
+ *           topmost 20 bytes of the stack are written
+ */
+void sched_prepare_task(PCB * task, uint32_t entry_point, uint32_t user_stack)
+{
+	uint32_t * sp = (uint32_t *)((uint32_t)task + _8KB);
+	*(--sp) = USER_DS;			// ss
+	*(--sp) = user_stack;		// esp
+	*(--sp) = USER_EFLAGS;		// eflags, interrupts on in user space
+	*(--sp) = USER_CS;			// cs
+	*(--sp) = entry_point;		// eip
+	sched_prepare_context(task, (uint32_t)sp, (uint32_t)task_start);
+}
+
+/* sched_prepare_fork
+ *    INPUT: task - new task, its PCB copied from 'parent'
+ *           parent - task inside the fork system call
+ * FUNCTION: copies the parent's system call frame (its user registers and the iret frame back to
+ *           user space, the top of its kernel stack) to the top of the task's with eax cleared, and
+ *           a saved context that resumes in fork_return with the stack pointing at it. So the
+ *           task continues where the parent called fork, with fork returning 0
+ */
+void sched_prepare_fork(PCB * task, PCB * parent)
+{
+	uint32_t * sp = (uint32_t *)((uint32_t)task + _8KB) - FORK_FRAME_WORDS;
+	memcpy(sp, (uint32_t *)((uint32_t)parent + _8KB) - FORK_FRAME_WORDS, FORK_FRAME_WORDS * 4);
+	sp[FORK_FRAME_EAX] = 0;
+	sched_prepare_context(task, (uint32_t)sp, (uint32_t)fork_return);
+}
+
+/* sleep_on
+ *    INPUT: queue - event to wait for
+ * FUNCTION: blocks the current task on 'queue' and runs something else until wake_up. Callers
+ *           check their condition with interrupts off before sleeping so no wake up is missed
+ */
+void sleep_on(wait_queue_t * queue)
+{
+	PCB * task = sched_current;
+	uint32_t flags;
+
+	cli_and_save(flags);
+	if(task != NULL) {
+		task->state = TASK_BLOCKED;
+		list_add_tail(&queue->head, &task->node);
+		schedule();
+	}
+	restore_flags(flags);
+}
+
+/* wake_up
+ *    INPUT: queue - event that happened
+ * FUNCTION: makes every task sleeping on 'queue' runnable, the policy may favour them
+ */
+void wake_up(wait_queue_t * queue)
+{
+	PCB * task;
+	uint32_t flags;
+
+	cli_and_save(flags);
+	while((task = list_pop(&queue->head)) != NULL)
+		runq_add(task, SCHED_WOKEN);
+	restore_flags(flags);
+}
+
+/* wake_up_task
+ *    INPUT: task - task sleeping on a wait queue
+ * FUNCTION: takes just 'task' off its queue and makes it runnable, for wakers that pick sleepers
+ *           themselves (futex_wake)
+ */
+void wake_up_task(PCB * task)
+{
+	uint32_t flags;
+
+	cli_and_save(flags);
+	list_del(&task->node);
+	runq_add(task, SCHED_WOKEN);
+	restore_flags(flags);
+}
+
+/* bench_peer_loop
+ *    INPUT: none
+ * FUNCTION: other side of switch_benchmark, switches straight back every time it is resumed
+ */
+static void bench_peer_loop(void)
+{
+	for(;;)
+		switch_to(&bench_peer, &bench_main);
+}
+
+/* switch_benchmark
+ *    INPUT: none
+ * FUNCTION: boot-time measurement of switch_to alone: bounces between the boot context and a
+ *           context on a spare frame SWITCH_BENCH_ROUNDS times and prints the cycles per switch.
+ *           A full task switch adds the clock sync, timer re-arm and cr3 load of context_switch
+ */
+void switch_benchmark(void)
+{
+	uint32_t stack = frame_alloc();
+	uint32_t start, cycles, i, flags;
+	if(stack == 0)
+		return;
+
+	bench_peer.esp = stack + FRAME_SIZE - sizeof(uint32_t); // bench_peer_loop never returns, its return slot stays empty
+	bench_peer.eip = (uint32_t)bench_peer_loop;
+	bench_peer.eflags = KERNEL_EFLAGS;
+	bench_peer.esp0 = tss.esp0;
+	bench_peer.fs = KERNEL_DS;
+	bench_peer.gs = KERNEL_DS;
+	bench_main.esp0 = tss.esp0;
+
+	cli_and_save(flags);
+	switch_to(&bench_main, &bench_peer); // warm up
+	start = rdtsc();
+	for(i = 0; i < SWITCH_BENCH_ROUNDS; i++)
+		switch_to(&bench_main, &bench_peer);
+	cycles = rdtsc() - start;
+	restore_flags(flags);
+
+	frame_free(stack);
+	printf("context switch: %d cycles per switch_to\n", cycles / (2 * SWITCH_BENCH_ROUNDS));
+}
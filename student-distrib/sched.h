@@ -0,0 +1,105 @@
+/* sched.h - Task states, run queue and wait queues
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _sched_H
+#define _sched_H
+
+#include "types.h"
+
+// task states (PCB state field)
+#define TASK_UNUSED 0 // slot is free
+#define TASK_RUNNABLE 1 // running, or waiting on the run queue
+#define TASK_BLOCKED 2 // on a wait queue, or waiting for its child to halt
+#define TASK_ZOMBIE 3 // halted, exit status not collected by the parent yet
+
+#define SCHED_TICKS 2 // PIT ticks per round robin quantum (20 ms at 100 Hz)
+#define USER_STACK_TOP 0x083FFFFC // 0x08400000 - 4 (bottom of 4 MB page holding executable)
+#define USER_EFLAGS 0x202 // IF set, bit 1 is reserved and always 1
+#define FORK_FRAME_WORDS 13 // system call frame at the top of a kernel stack: pushal (8) and the iret frame (5)
+#define FORK_FRAME_EAX 7 // eax in that frame
+#define SWITCH_BENCH_ROUNDS 10000 // round trips timed by switch_benchmark
+
+/* Intrusive list link kept inside every PCB. A task is on at most one list at
+ * a time: the run queue while it is runnable but not running, or the wait
+ * queue it sleeps on. next is NULL while the task is on no list. */
+typedef struct __attribute__((packed)) sched_node {
+	struct sched_node * next;
+	struct sched_node * prev;
+} sched_node_t;
+
+/* Tasks sleeping on an event, oldest first (head is a circular list sentinel) */
+typedef struct wait_queue {
+	sched_node_t head;
+} wait_queue_t;
+
+// why a task is being queued, policies may place it differently
+#define SCHED_NEW 0 // just created
+#define SCHED_PREEMPTED 1 // used up its quantum
+#define SCHED_WOKEN 2 // woke from a wait queue
+#define SCHED_YIELD 3 // gave up the cpu while still runnable
+
+// scheduling policy jump table (like the file operation tables in syscalls.c)
+#define POLICY_OP_INIT 0 // void init(void) : empty the policy's queues
+#define POLICY_OP_ENQUEUE 1 // void enqueue(PCB * task, uint32_t reason)
+#define POLICY_OP_PICK 2 // PCB * pick(void) : dequeue the task to run next, NULL if none
+#define POLICY_OP_QUANTUM 3 // uint32_t quantum(PCB * task) : ticks 'task' may run
+#define NUM_POLICY_OPS 4
+
+#define SCHED_POLICY_RR 0 // one queue, SCHED_TICKS each
+#define SCHED_POLICY_MLFQ 1 // multilevel feedback queue
+#define NUM_SCHED_POLICIES 2
+#define SCHED_DEFAULT_POLICY SCHED_POLICY_MLFQ
+
+#define MLFQ_LEVELS 4 // level 0 runs first, level n gets a quantum of 2^n ticks
+#define MLFQ_BOOST_TICKS 100 // every second all tasks go back to level 0 so none starve
+#define MLFQ_FOREGROUND_BOOST 1 // levels a task of the terminal on screen is raised while it waits
+
+struct PCB_struct;
+
+/* policy jump tables, indexed by SCHED_POLICY_* (sched_policy.c) */
+extern uint32_t * sched_policies[NUM_SCHED_POLICIES];
+
+/* list helpers shared with the policies */
+void list_init(sched_node_t * head);
+void list_add_tail(sched_node_t * head, sched_node_t * node);
+void list_del(sched_node_t * node);
+struct PCB_struct * list_pop(sched_node_t * head);
+struct PCB_struct * task_of(sched_node_t * node);
+
+void sched_init(void);
+/* switch to another SCHED_POLICY_*, queued tasks move over */
+int32_t sched_set_policy(uint32_t which);
+/* ticks the current policy lets 'task' run */
+uint32_t sched_quantum(struct PCB_struct * task);
+void wait_queue_init(wait_queue_t * queue);
+/* make a runnable task eligible to run (appends it to the run queue) */
+void sched_enqueue(struct PCB_struct * task);
+/* give up the cpu to the next runnable task (requeues the current one if it is still runnable) */
+void schedule(void);
+/* idle task, entered by the boot context once the first tasks are queued (never returns) */
+void sched_idle(void);
+/* switch straight to 'next', used to hand the cpu to a new child or back to a parent */
+void sched_run(struct PCB_struct * next);
+/* give the current slot a freshly prepared context (never returns) */
+void sched_restart(struct PCB_struct * task);
+/* build the first kernel stack frame of a new task so switching to it enters user space */
+void sched_prepare_task(struct PCB_struct * task, uint32_t entry_point, uint32_t user_stack);
+/* the same for a forked task, which resumes from a copy of its parent's system call frame */
+void sched_prepare_fork(struct PCB_struct * task, struct PCB_struct * parent);
+/* block the current task on 'queue' until wake_up */
+void sleep_on(wait_queue_t * queue);
+/* make every task on 'queue' runnable */
+void wake_up(wait_queue_t * queue);
+/* make one task sleeping on a wait queue runnable */
+void wake_up_task(struct PCB_struct * task);
+void context_switch(struct PCB_struct * prev, struct PCB_struct * next);
+/* print the cost of one switch_to, measured at boot */
+void switch_benchmark(void);
+
+struct PCB_struct * sched_current; // task on the cpu, NULL while the idle task runs
+uint32_t sched_policy; // SCHED_POLICY_* in use
+uint32_t sched_idle_ticks; // PIT ticks that found the cpu idle (busy ticks are timer_ticks minus these)
+uint32_t sched_idle_entries; // times the idle task halted the cpu
+
+#endif /* _sched_H */
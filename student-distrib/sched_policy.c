@@ -0,0 +1,152 @@
+#include "sched.h"
+#include "syscalls.h"
+
+/* Scheduling policies. Each one owns the queues of runnable tasks that are not
+ * on the cpu and is reached through a jump table, so sched.c never looks at how
+ * tasks are ordered. All of these run with interrupts off. */
+
+/* round robin: one queue, everybody gets SCHED_TICKS */
+static sched_node_t rr_queue;
+
+/* rr_init
+ *    INPUT: none
+ * FUNCTION: empties the queue
+ */
+static void rr_init(void)
+{
+	list_init(&rr_queue);
+}
+
+/* rr_enqueue
+ *    INPUT: task - runnable task
+ *           reason - ignored, every task goes to the back
+ * FUNCTION: appends 'task' to the queue
+ */
+static void rr_enqueue(PCB * task, uint32_t reason)
+{
+	list_add_tail(&rr_queue, &task->node);
+}
+
+/* rr_pick
+ *    INPUT: none
+ * FUNCTION: dequeues the task that has waited longest
+ */
+static PCB * rr_pick(void)
+{
+	return list_pop(&rr_queue);
+}
+
+/* rr_quantum
+ *    INPUT: task - task being switched in
+ * FUNCTION: every task gets the same quantum
+ */
+static uint32_t rr_quantum(PCB * task)
+{
+	return SCHED_TICKS;
+}
+
+/* multilevel feedback queue: a task that uses its whole quantum drops a level
+ * (and gets a longer quantum there), one that wakes from I/O goes back to the
+ * top. Tasks of the terminal on screen wait MLFQ_FOREGROUND_BOOST levels higher
+ * than their own, so typing stays responsive next to a background cpu hog. */
+static sched_node_t mlfq_queue[MLFQ_LEVELS];
+static uint32_t mlfq_last_boost; // timer_ticks at the last priority boost
+
+/* mlfq_init
+ *    INPUT: none
+ * FUNCTION: empties every level
+ */
+static void mlfq_init(void)
+{
+	int i;
+	for(i = 0; i < MLFQ_LEVELS; i++)
+		list_init(&mlfq_queue[i]);
+	mlfq_last_boost = timer_ticks;
+}
+
+/* mlfq_enqueue
+ *    INPUT: task - runnable task
+ *           reason - why it is queued, decides its new level
+ * FUNCTION: updates the task's level and appends it to the queue it waits on
+ */
+static void mlfq_enqueue(PCB * task, uint32_t reason)
+{
+	uint32_t queue;
+	switch(reason) {
+		case SCHED_NEW:
+		case SCHED_WOKEN:
+			task->level = 0;
+			break;
+		case SCHED_PREEMPTED:
+			if(task->level < MLFQ_LEVELS - 1)
+				task->level++;
+			break;
+		default: // SCHED_YIELD keeps its level
+			break;
+	}
+	queue = task->level;
+	if(task->terminal == current_terminal)
+		queue = (queue > MLFQ_FOREGROUND_BOOST) ? queue - MLFQ_FOREGROUND_BOOST : 0;
+	list_add_tail(&mlfq_queue[queue], &task->node);
+}
+
+/* mlfq_boost
+ *    INPUT: none
+ * FUNCTION: moves every waiting task (and the running one) back to level 0, keeping their order.
+ *           Foreground tasks can already sit in queue 0 from a lower level, so their level is
+ *           reset too
+ */
+static void mlfq_boost(void)
+{
+	PCB * task;
+	sched_node_t * node;
+	int i;
+	for(node = mlfq_queue[0].next; node != &mlfq_queue[0]; node = node->next)
+		task_of(node)->level = 0;
+	for(i = 1; i < MLFQ_LEVELS; i++) {
+		while((task = list_pop(&mlfq_queue[i])) != NULL) {
+			task->level = 0;
+			list_add_tail(&mlfq_queue[0], &task->node);
+		}
+	}
+	if(sched_current != NULL)
+		sched_current->level = 0;
+	mlfq_last_boost = timer_ticks;
+}
+
+/* mlfq_pick
+ *    INPUT: none
+ * FUNCTION: dequeues the first task of the highest non-empty level, boosting everyone first if
+ *           MLFQ_BOOST_TICKS have passed
+ */
+static PCB * mlfq_pick(void)
+{
+	PCB * task;
+	int i;
+	if(timer_ticks - mlfq_last_boost >= MLFQ_BOOST_TICKS)
+		mlfq_boost();
+	for(i = 0; i < MLFQ_LEVELS; i++) {
+		if((task = list_pop(&mlfq_queue[i])) != NULL)
+			return task;
+	}
+	return NULL;
+}
+
+/* mlfq_quantum
+ *    INPUT: task - task being switched in
+ * FUNCTION: 2^level ticks: interactive tasks get short slices, cpu bound ones long ones
+ */
+static uint32_t mlfq_quantum(PCB * task)
+{
+	return 1 << task->level;
+}
+
+uint32_t rr_policy[NUM_POLICY_OPS] = {
+	(uint32_t)rr_init, (uint32_t)rr_enqueue, (uint32_t)rr_pick, (uint32_t)rr_quantum
+};
+uint32_t mlfq_policy[NUM_POLICY_OPS] = {
+	(uint32_t)mlfq_init, (uint32_t)mlfq_enqueue, (uint32_t)mlfq_pick, (uint32_t)mlfq_quantum
+};
+uint32_t * sched_policies[NUM_SCHED_POLICIES] = {
+	rr_policy, mlfq_policy
+};
@@ -0,0 +1,61 @@
+/* switch.h - Saved kernel context of a task and the assembly routines that switch it
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _switch_H
+#define _switch_H
+
+// offsets into cpu_context_t, used by switch.S
+#define CTX_ESP 0
+#define CTX_EBP 4
+#define CTX_EBX 8
+#define CTX_ESI 12
+#define CTX_EDI 16
+#define CTX_EIP 20
+#define CTX_EFLAGS 24
+#define CTX_ESP0 28
+#define CTX_FS 32
+#define CTX_GS 34
+#define TSS_ESP0 4 // offset of esp0 in tss_t
+
+#define KERNEL_EFLAGS 0x2 // IF clear (switches happen with interrupts off), bit 1 is reserved and always 1
+
+#ifndef ASM
+
+#include "types.h"
+
+/*
+cpu_context: (kernel state of a task that is not on the cpu, first field of the PCB)
+1. esp : kernel stack pointer
+2. ebp, ebx, esi, edi : callee-saved registers, the rest are saved by the caller of switch_to
+3. eip : where the task resumes, inside switch_to for a switched out task, task_start for a new one,
+         fork_return for a forked one
+4. eflags : restored before jumping to eip
+5. esp0 : top of the task's kernel stack, loaded into tss.esp0 for its interrupts and system calls
+6. fs, gs : segment registers the kernel does not reload on entry
+*/
+typedef struct __attribute__((packed)) cpu_context {
+	uint32_t esp;
+	uint32_t ebp;
+	uint32_t ebx;
+	uint32_t esi;
+	uint32_t edi;
+	uint32_t eip;
+	uint32_t eflags;
+	uint32_t esp0;
+	uint16_t fs;
+	uint16_t gs;
+} cpu_context_t;
+
+/* save the running context in 'prev' and resume 'next', returns when 'prev' is switched back to */
+extern void switch_to(cpu_context_t * prev, cpu_context_t * next);
+/* first code of a new task: irets to user space through the frame sched_prepare_task built */
+extern void task_start(void);
+/* first code of a forked task: pops the copied system call frame and irets to user space */
+extern void fork_return(void);
+/* interrupt entry stubs, save all registers around the C handlers */
+extern void PIT_HANDLER(void);
+extern void APIC_TIMER_HANDLER(void);
+
+#endif /* ASM */
+#endif /* _switch_H */
@@ -19,27 +19,103 @@ uint32_t file_jump[NUM_FILE_OPS] = {
 uint32_t directory_jump[NUM_FILE_OPS]=	{
 	(uint32_t)open_directory, (uint32_t)read_directory, (uint32_t)directory_write, (uint32_t)directory_close
 };
+uint32_t pipe_read_jump[NUM_FILE_OPS] = {
+	(uint32_t)pipe_open, (uint32_t)pipe_read, (uint32_t)pipe_bad_write, (uint32_t)pipe_close_read
+};
+uint32_t pipe_write_jump[NUM_FILE_OPS] = {
+	(uint32_t)pipe_open, (uint32_t)pipe_bad_read, (uint32_t)pipe_write, (uint32_t)pipe_close_write
+};
 
 PCB * pc_block;
 
-/* sys_execute
+static exec_image_t image_cache[IMAGE_CACHE_SIZE];
+
+/* user_buffer_ok
+ *    INPUT: buf - user pointer from a system call
+ *           size - bytes the kernel will read or write there
+ * FUNCTION: returns 1 if all of [buf, buf + size) lies in the program page, 0 otherwise
+ */
+static int user_buffer_ok(const void* buf, uint32_t size)
+{
+	uint32_t start = (uint32_t)buf;
+	return start >= _128MB && start <= _132MB && size <= _132MB - start;
+}
+
+/* user_buffer_writable
+ *    INPUT: buf - user pointer the kernel will write through
+ *           size - bytes it will write there
+ * FUNCTION: returns 1 if [buf, buf + size) lies in the program page and the kernel may write all
+ *           of it, 0 otherwise. With CR0.WP a kernel write to a read-only page faults: pages not
+ *           loaded yet are loaded and copy-on-write pages copied, but the shared text pages
+ *           have nothing to fall back on, so buffers overlapping them are refused up front
+ */
+int user_buffer_writable(void* buf, uint32_t size)
+{
+	page_table_desc_t* table = program_page_table[get_pcb_ptr()->group];
+	uint32_t entry, last;
+
+	if(!user_buffer_ok(buf, size))
+		return 0;
+	if(size == 0)
+		return 1;
+	last = ((uint32_t)buf + size - 1 - _128MB) / KiB4;
+	for(entry = ((uint32_t)buf - _128MB) / KiB4; entry <= last; entry++) {
+		if(table[entry].present && !table[entry].read_write && !(table[entry].avail & PTE_AVAIL_COW))
+			return 0;
+	}
+	return 1;
+}
+
+/* process_claim_slot
+ *    INPUT: pid - slot to use, or -1 to claim a free one
+ * FUNCTION: marks the slot used and makes sure it has a kernel stack (from the frame allocator, a
+ *           slot keeps its stack once it has one). Returns the slot, or NO_PROCESS_SLOT if there is
+ *           no free slot or no memory (a message is printed)
+ */
+static int32_t process_claim_slot(int32_t pid)
+{
+	int32_t i;
+	if(pid < 0) {
+		for(i = 0; i < MAX_NUM_PROCESSES && process_array[i] != 0; i++);
+		if(i == MAX_NUM_PROCESSES) { // no process available
+			printf("Maximum number of active programs reached (%d)\n", MAX_NUM_PROCESSES);
+			return NO_PROCESS_SLOT;
+		}
+		pid = i;
+	}
+	process_array[pid] = 1; // a caller passing pid already owns the slot
+	if(pcb_table[pid] == NULL)
+		pcb_table[pid] = (PCB*)frame_alloc_contig(KERNEL_STACK_FRAMES);
+	if(pcb_table[pid] == NULL) {
+		process_array[pid] = 0;
+		printf("Not enough memory to start another program\n");
+		return NO_PROCESS_SLOT;
+	}
+	return pid;
+}
+
+/* process_create
 	INPUT:
-		command - file name of program being executed
+		command - file name of program being executed, followed by its arguments
+		parent - pid of the parent, -1 for the root shell of a terminal
+		pid - slot to use, or -1 to claim a free one
 	FUNCTION:
-		Executes corresponding file as a process
+		Loads the program into a new process that is ready to run but not yet scheduled:
+		paging, PCB and file descriptors are set up and its kernel stack is prepared so
+		the first switch to it enters the program
 		Returns -
-			-1    : command can't be executed
-			256   : program dies by exeption
-			0-255 : program executes `halt` system call
+			pid             : the new process
+			-1              : command can't be executed
+			NO_PROCESS_SLOT : no pid slot or not enough memory (a message is printed)
 */
-int32_t sys_execute (const uint8_t* command)
+int32_t process_create(const uint8_t* command, int32_t parent, int32_t pid)
 {
-	cli();
 	int i = 0, arg_i = 0, current_process = INITIAL_PID;
 	int entry_point;
+	exec_image_t* exe;
 	uint8_t file[FILE_SIZE]; // 32 = max file name length in file_system
 	uint8_t args[ARG_SIZE]; // 1024 = max size of buffer
-	uint8_t buffer[4]; // ELF and entry point occupy 4 bytes only
+	uint8_t header[ELF_HEADER_SIZE]; // ELF magic and entry point
 
 
 	//---------- PARSE ARGS ----------//
@@ -65,49 +141,47 @@ int32_t sys_execute (const uint8_t* command)
 	if(read_dentry_by_name(file, &file_dentry) == ERROR)
 		return ERROR; // command can't be executed 
 
-	/*----------- CHECK IF PROCESS AVAILABLE ------------*/
-	for(i = 0; i < MAX_NUM_PROCESSES; i++) {
-		if(process_array[i] == 0) {
-			current_process = i;
-			process_array[i] = 1;
+	// check if file is executable (ELF) before claiming a process slot
+		// check ELF magic constant (0x7F, 0x45, 0x4C, 0x46)
+		// read bytes 24-27 to get entry point into program
+	// this is the only read of the header, the rest of the image is paged in on first touch
+	file_cursor_t image;
+	cursor_init(&image, file_dentry.inode_number);
+	if(cursor_read(&image, header, ELF_HEADER_SIZE) != ELF_HEADER_SIZE)
+		return ERROR;
+	if(!(header[0] == 0x7F && header[1] == 0x45 &&
+		 header[2] == 0x4C && header[3] == 0x46)) // ELF magic constants
+		return ERROR;	// ELF not correct
+	entry_point = *((uint32_t*)(header + ELF_ENTRY_OFFSET)); // used for context switch later "fake IRET", goes to EIP
 
-			break;
-		}
-		else if(i == 5) { // no process available (limit at 2 for cp3 [0,1]) (limit at 6)
-			printf("Maximum number of active programs reached (6)\n");
-			return 0; // don't return error, because behaves as expected
-		}
+	/*----------- CHECK IF PROCESS AVAILABLE ------------*/
+	current_process = process_claim_slot(pid);
+	if(current_process == NO_PROCESS_SLOT)
+		return NO_PROCESS_SLOT;
+	if(process_paging_alloc(current_process) == ERROR) {
+		process_array[current_process] = 0;
+		printf("Not enough memory to start another program\n");
+		return NO_PROCESS_SLOT;
 	}
 
-	running_process = current_process;
-
 	/*---------- SET UP PAGING ----------*/
 		// page starts at 128MB (virtual memory)
-		// physical memory starts at 8MB + (process # * 4MB)
-		// process # starts at 0
-		// FLUSH TLB when swapping page
-	program_paging(_8MB + (current_process * _4MB)); // 8MB is physical address of first program
+		// each 4 KB page gets a physical frame from the allocator when it is first touched
+		// 4 KB pages start out not present, nothing is copied here
+		// text/rodata pages are shared by every instance: map them read-only onto the file's data blocks
+		// the address space is loaded when the scheduler first switches to the process
+	exe = image_get(file_dentry.inode_number, header);
+	if(exe != NULL) {
+		for(i = 0; i < MAX_IMAGE_PAGES; i++) {
+			if(exe->shared[i / 32] & (1u << (i % 32)))
+				program_map_page_ro(current_process, IMAGE_FIRST_ENTRY + i, (uint32_t)cursor_block(&image, i));
+		}
+	}
 
 
 	/*---------- LOAD FILE INTO MEMORY ----------*/
-		// check ELF magic constant (0x7F, 0x45, 0x4C, 0x46)
-		// copy file contents to mem location
-		// find first instr address
-	// check if file is executable (ELF)
-	read_data(file_dentry.inode_number, 0, buffer, 4);
-	if(!(buffer[0] == 0x7F && buffer[1] == 0x45 &&
-		 buffer[2] == 0x4C && buffer[3] == 0x46)) // ELF magic constants
-		return ERROR;	// ELF not correct
-
-	// read bytes 24-27 to get entry point into program
-	read_data(file_dentry.inode_number, 24, buffer, 4); // used for context switch later "fake IRET", goes to EIP
-	entry_point = *((uint32_t*)buffer);
-
-	inode_t * file_inode = (inode_t *)boot_block + 1 + file_dentry.inode_number;
-	// copy starting at virtual address 0x08048000
-	read_data(file_dentry.inode_number, 0, (uint8_t*)PROGRAM_IMG_START, file_inode->length_in_bytes); 
-	// idk how large length should be
-
+		// pages of the image (mapped at virtual address 0x08048000) are copied in by
+		// load_program_page when they are first touched, so untouched pages cost nothing
 
 	/*--------- CREATE PCB/Open FDs ----------*/
 		// unique to each process
@@ -115,105 +189,156 @@ int32_t sys_execute (const uint8_t* command)
 		// fd[1] = stdout , terminal output
 		// fd[2-7] = dynamically assigned stuff
 
-	// 1. Set up PCB at bottom of kernel page - 8kB * (process + 1)
-	pc_block = (PCB*)(_8MB - _8KB * (current_process + 1) );
+	// 1. Set up PCB at bottom of the process's kernel stack
+	pc_block = pcb_table[current_process];
 	pc_block->p_id = current_process;
-
-	if(current_process > 2){ // check if not in first 3 shells
-		pc_block->parent = get_pcb_ptr()->p_id; // parent is p_id of current stack
-		get_pcb_ptr()->child = current_process; // set parent's child to this
-	} else {
-		pc_block->parent = -1;
-	}
+	pc_block->parent = parent;
 	pc_block->child = -1; // -1 = no child = running in scheduling
 		
 	for(i=0; i<arg_i; i++)
 		pc_block->args[i] = args[i]; // set pcb args to the parsed args
 	pc_block->size_args = arg_i;
-
-	asm("movl %%ebp, %%eax;"
-		"movl %%esp, %%ebx;"
-		: "=a"(pc_block->ebp_halt), "=b"(pc_block->esp_halt)
-		:
-		: "memory"
-		);
+	pc_block->mmap_next = USER_MMAP_FIRST_ENTRY;
+	pc_block->image = image;
+	pc_block->exe = exe;
+	pc_block->exit_status = 0;
+	pc_block->run_ticks = 0;
+	pc_block->terminal = (parent < 0) ? current_process : get_pcb_by_pid(parent)->terminal;
+	pc_block->level = 0;
+	pc_block->user_ticks = 0;
+	pc_block->kernel_ticks = 0;
+	pc_block->nvcsw = 0;
+	pc_block->nivcsw = 0;
+	pc_block->syscalls = 0;
+	pc_block->in_kernel = 0;
+	pc_block->spawned = 0;
+	wait_queue_init(&pc_block->child_wait);
+	pc_block->group = current_process;
+	pc_block->threads = 1;
+	pc_block->futex_key = 0;
+	pc_block->exiting = 0;
+	for(i = 0; i < FILE_SIZE && file[i] != '\0'; i++)
+		pc_block->name[i] = file[i];
+	if(i < FILE_SIZE)
+		pc_block->name[i] = '\0';
 
 	// 2. Open FDs
 	process_start_file_d(pc_block->fd);
 
-	/*---------- PREPARE FOR AND CALL IRET ----------*/
+	/*---------- PREPARE FOR IRET ----------*/
 	// https://web.archive.org/web/20160326062442/http://jamesmolloy.co.uk/tutorial_html/10.-User%20Mode.html
-	tss.ss0 = 0x18;	// 0x18 is KERNEL_DS
-	tss.esp0 = _8MB - _8KB * current_process-4 ; // top of kernel page
-	int32_t return_value;
-	asm volatile("movl $0x2B, %%eax;"	// 0x2B is USER_DS
-				 "movw %%ax, %%ds;"
-				 "movl $0x083FFFFC, %%eax;" // 0x08400000 - 4 (bottom of 4 MB page holding executable)
-				 "pushl $0x2B;"
-				 "pushl %%eax;"
-				 "pushfl;"	// push flags
-				 "popl %%eax;"	// Enable IF flag so interrupts reenabled when IRET executed
-				 "orl $0x200, %%eax;"
-				 "pushl %%eax;"
-				 "pushl $0x23;"	// 0x23 is USER_CS
-				 "pushl %%ebx;"	// ebx contains entry_point
-				 "iret;"
-				 "halt_goto_label:"
-				 : "=a"(return_value)
-				 : "b"(entry_point)
-				 : "memory", "cc"
-				 );
-	return return_value;
+	// the first switch to the process "returns" into task_start, which irets to the entry point
+	tss.ss0 = KERNEL_DS;
+	sched_prepare_task(pc_block, entry_point, USER_STACK_TOP);
+	return current_process;
+}
+
+/* process_start_shells
+ *    INPUT: none
+ * FUNCTION: creates the root shell of each terminal and queues them, they start running on the
+ *           first PIT tick after interrupts are enabled
+ */
+void process_start_shells(void)
+{
+	int i;
+	for(i = 0; i < NUM_ROOT_SHELLS; i++) {
+		if(process_create((uint8_t*)"shell", -1, i) == i)
+			sched_enqueue(pcb_table[i]);
+	}
+	current_terminal = NUM_ROOT_SHELLS - 1; // the last shell started is the one on screen (F1)
+	kinfo_set_screen(current_terminal);
+}
+
+/* sys_execute
+	INPUT:
+		command - file name of program being executed
+	FUNCTION:
+		Executes corresponding file as a process
+		Returns -
+			-1    : command can't be executed
+			256   : program dies by exeption
+			0-255 : program executes `halt` system call
+*/
+int32_t sys_execute (const uint8_t* command)
+{
+	cli();
+	PCB* pcb = get_pcb_ptr();
+	PCB* child;
+	int32_t pid, status;
+
+	pid = process_create(command, pcb->p_id, -1);
+	if(pid == NO_PROCESS_SLOT)
+		return 0; // don't return error, because behaves as expected
+	if(pid < 0)
+		return ERROR;
+	child = pcb_table[pid];
+	process_inherit_stdio(child, get_group_ptr(), STDIN, STDOUT);
+
+	// the parent is off the run queue until the child halts and switches back to it
+	pcb->child = pid;
+	pcb->state = TASK_BLOCKED;
+	sched_run(child);
+
+	// the child is a zombie now: collect its status and free the slot
+	status = child->exit_status;
+	process_free_slot(child);
+	pcb->child = -1;
+	return status;
 }
 
 /* sys_halt
  *    INPUT: status (also the putput)
  * FUNCTION: halts current process, 
- *           if last shell, call execute again
+ *           if last shell, call execute again.
+ *           A group leader halting ends the whole process: its threads halt as they next return
+ *           to user space, and whichever task of the group halts last gives back the descriptors
+ *           and address space (the leader's slot is kept until then)
  */
 int32_t sys_halt (uint8_t status)
 {
 	cli();
 	PCB* pcb = get_pcb_ptr();
-	int restart_flag = 0;
-	int parent_pid = pcb->parent;
-	if(pcb->p_id < 3) {
-	 	restart_flag = 1;
-	}
+	PCB* group = get_group_ptr();
 
-	// free up process
-	process_array[pcb->p_id] = 0;
-
-	if(restart_flag){
-		sys_execute((uint8_t*)"shell");
-	}
+	if(pcb == group && pcb->threads > 1)
+		process_exit_threads(pcb, status);
+	if(--group->threads == 0)
+		process_release(group);
 
-	PCB* parent_pcb = (PCB*)(_8MB - _8KB * ( pcb->parent + 1) );
-	running_process	 = parent_pcb->p_id;
-	parent_pcb->child = -1;
-	
-	// restore to parent page
-	program_paging(_8MB + ((parent_pid) * _4MB));
+	// spawned children of this process have nobody to collect them now
+	process_orphan_children(pcb);
 
-	// restore to parent kernel stack
-	tss.esp0 = _8MB - _8KB * (parent_pid);
-	int j;
+	if(pcb->spawned) {
+		pcb->exit_status = status;
+		if(pcb->parent < 0) {
+			// orphan: free the slot now (its stack stays put until the next process_create)
+			process_free_slot(pcb);
+		}
+		else {
+			// a zombie until the parent collects the status with waitpid
+			pcb->state = TASK_ZOMBIE;
+			wake_up(&get_pcb_by_pid(pcb->parent)->child_wait);
+		}
+		if(pcb != group && group->threads == 0)
+			process_group_done(group);
+		schedule();
+	}
 
-	// close fd
-	for(j=0;j<TOTAL_NUMBER_OF_FILE_DESCRIPTORS;j++)
-	{
-		sys_close(j);
+	if(pcb->parent < 0) {
+		pcb->state = TASK_ZOMBIE;
+		if(pcb->threads > 0)
+			schedule(); // the slot is still in use, the last thread starts the new shell
+		// a terminal never loses its shell: start a new one in the same slot, on this stack
+		if(process_create((uint8_t*)"shell", -1, pcb->p_id) == pcb->p_id)
+			sched_restart(pcb);
+		process_array[pcb->p_id] = 0; // no memory for a new shell, this terminal goes quiet
+		schedule();
 	}
 
-	// restore esp and ebp
-	// avoid returning to caller
-	asm("movl %%ebx, %%ebp;"
-		"movl %%ecx, %%esp;"
-		"sti;"
-		"jmp halt_goto_label;"
-		: // no output
-		: "a"((uint32_t)status), "b"(pcb->ebp_halt), "c"(pcb->esp_halt)
-		);
+	// hand the cpu straight back to the parent, which returns 'status' from execute
+	pcb->exit_status = status;
+	pcb->state = TASK_ZOMBIE;
+	sched_run(get_pcb_by_pid(pcb->parent));
 
 	return 0;
 }
@@ -230,10 +355,12 @@ int32_t sys_read (int32_t fd, void* buf, int32_t nbytes)
 	if(fd < MIN_FD_INDEX || fd > MAX_FD_INDEX) // check for negative or very large fd's
 		return ERROR;
 	
-	PCB* pcb = get_pcb_ptr();
+	PCB* pcb = get_group_ptr(); // descriptors are shared by the threads of a process
 
 	if (!pcb->fd[fd].flag)
 	 	return ERROR;
+	if(nbytes > 0 && !user_buffer_writable(buf, nbytes))
+		return ERROR; // every driver's read is reached from here
 
 	// call jump table
 	uint32_t (*fd_read)(int32_t fd, void* buf, int32_t nbytes) = (void*)pcb->fd[fd].file_d_jump[FILE_OP_READ];
@@ -252,7 +379,7 @@ int32_t sys_write (int32_t fd, const void* buf, int32_t nbytes)
 	if(fd < MIN_FD_INDEX || fd > MAX_FD_INDEX) // check for negative or large fd's
 		return ERROR;
 
-	PCB* pcb = get_pcb_ptr();
+	PCB* pcb = get_group_ptr();
 
 	if (!pcb->fd[fd].flag)
 	 	return ERROR;
@@ -282,21 +409,23 @@ int32_t sys_open (const uint8_t* filename)
 	switch(file_dentry.file_type) {
 		case RTCFILETYPE :
 			fd->file_d_jump = rtc_jump;
-			fd->inode_num = FILE_START;
-			fd->file_pos = 0;
+			cursor_init(&fd->cursor, FILE_START);
+			fd->cursor.inode = NULL; // not data file
+			open_rtc_fd(fd_index);
 			break;
 		case DIRECTORYFILETYPE:
 			fd->file_d_jump = directory_jump;
-			fd->inode_num = FILE_START;
-			fd->file_pos = 0;
+			cursor_init(&fd->cursor, FILE_START);
+			fd->cursor.inode = NULL; // not data file
 			break;
 		case REGULARFILETYPE:
 			fd->file_d_jump = file_jump;
-			fd->inode_num = file_dentry.inode_number;
-			fd->file_pos = 0;
+			cursor_init(&fd->cursor, file_dentry.inode_number);
 			break;
+		default:
+			return ERROR;
 	}
-	fd->file_pos = FILE_START;
+	fd->pipe = NULL;
 	fd->flag = FLAG_SET;
 	return fd_index;
 }
@@ -310,7 +439,7 @@ int32_t sys_close (int32_t fd)
 {
 	if(fd < FIRST_NON_STD_FD || fd > MAX_FD_INDEX) // exclude 0 and 1
 		return ERROR;
-	PCB* pcb = get_pcb_ptr();
+	PCB* pcb = get_group_ptr();
 
 	if (!pcb->fd[fd].flag)
 	 	return ERROR;
@@ -336,6 +465,8 @@ int32_t sys_getargs (uint8_t* buf, int32_t nbytes)
 
 	if(nbytes < pcb->size_args - 1)  // -1 due to need for '\0'
 		return ERROR;
+	if(!user_buffer_writable(buf, pcb->size_args + 1))
+		return ERROR;
 
 	// 2. copy to `buf` in userspace
 	for(i = 0; i < nbytes && i < pcb->size_args; i++){
@@ -353,7 +484,7 @@ int32_t sys_getargs (uint8_t* buf, int32_t nbytes)
 int32_t sys_vidmap (uint8_t** screen_start)
 {
 	// check that provided address is within user virtual address space
-	if((uint32_t*)screen_start < (uint32_t*)_132MB && (uint32_t*)screen_start >= (uint32_t*)_128MB) {
+	if(user_buffer_writable(screen_start, sizeof(uint8_t*))) {
 		user_mapping();
 		*screen_start = (uint8_t*)_132MB;
 		return 0;
@@ -381,6 +512,471 @@ int32_t sys_sigreturn (void)
 	return ERROR;
 }
 
+/* sys_mmap
+ *    INPUT: fd - open regular file to map
+ *           start - user pointer that receives the address of the mapping
+ * FUNCTION: maps the file's data blocks read-only into the process's user page table, straight
+ *           out of the in-memory filesystem image, so the file can be scanned without copying.
+ *           Pages past the end of the file hold whatever follows in its last block.
+ *           Returns the file length in bytes, or -1 on error
+ */
+int32_t sys_mmap (int32_t fd, uint8_t** start)
+{
+	uint32_t i, num_pages, length;
+	uint8_t * block;
+
+	if(fd < FIRST_NON_STD_FD || fd > MAX_FD_INDEX)
+		return ERROR;
+	if(!user_buffer_writable(start, sizeof(uint8_t*)))
+		return ERROR;
+	if(!fs_blocks_page_aligned())
+		return ERROR; // blocks can only be mapped if the image sits on page boundaries
+
+	PCB* pcb = get_group_ptr();
+	if(!pcb->fd[fd].flag || pcb->fd[fd].file_d_jump != file_jump)
+		return ERROR; // only regular files have data blocks
+
+	length = pcb->fd[fd].cursor.inode->length_in_bytes;
+	num_pages = (length + KiB4 - 1) / KiB4;
+	if(pcb->mmap_next + num_pages > NUM_PAGE_TABLE_ENTRIES)
+		return ERROR; // mmap region of this process is full
+
+	for(i = 0; i < num_pages; i++) {
+		block = cursor_block(&pcb->fd[fd].cursor, i);
+		if(block == NULL)
+			return ERROR;
+		user_map_page_ro(pcb->p_id, pcb->mmap_next + i, (uint32_t)block);
+	}
+	// the pages were not present before, and not-present entries are never in the TLB: nothing to flush
+
+	*start = (uint8_t*)(USER_VIDEO_ADDRESS + pcb->mmap_next * KiB4);
+	pcb->mmap_next += num_pages;
+	return length;
+}
+
+/* sys_stats
+ *    INPUT: pid - process to report on, or STATS_SYSTEM
+ *           buf - user buffer for a proc_stat_t (or a sys_stat_t for STATS_SYSTEM)
+ * FUNCTION: copies out cpu accounting, for monitors like top. Returns 0, or -1 if the pid slot
+ *           holds no process or buf does not fit in the program page
+ */
+int32_t sys_stats (int32_t pid, void* buf)
+{
+	PCB* pcb;
+	proc_stat_t* ps = buf;
+	sys_stat_t* ss = buf;
+	int i;
+
+	if(!user_buffer_writable(buf, (pid == STATS_SYSTEM) ? sizeof(sys_stat_t) : sizeof(proc_stat_t)))
+		return ERROR;
+
+	if(pid == STATS_SYSTEM) {
+		ss->ticks = timer_ticks;
+		ss->idle_ticks = sched_idle_ticks;
+		ss->timer_interrupts = timer_interrupts;
+		ss->policy = sched_policy;
+		ss->frames_free = frames_free;
+		ss->frames_total = frames_total;
+		return 0;
+	}
+
+	pcb = get_pcb_by_pid(pid);
+	if(pcb == NULL || !process_array[pid] || pcb->state == TASK_UNUSED)
+		return ERROR;
+	ps->pid = pcb->p_id;
+	ps->parent = pcb->parent;
+	ps->terminal = pcb->terminal;
+	ps->state = pcb->state;
+	ps->level = pcb->level;
+	ps->user_ticks = pcb->user_ticks;
+	ps->kernel_ticks = pcb->kernel_ticks;
+	ps->nvcsw = pcb->nvcsw;
+	ps->nivcsw = pcb->nivcsw;
+	ps->syscalls = pcb->syscalls;
+	for(i = 0; i < FILE_SIZE && pcb->name[i] != '\0'; i++)
+		ps->name[i] = pcb->name[i];
+	ps->name[i] = '\0';
+	return 0;
+}
+
+/* sys_clock_gettime
+ *    INPUT: clock_id - CLOCK_MONOTONIC, the only clock there is
+ *           ts - user buffer for the time
+ * FUNCTION: stores the time since boot from the TSC clock of the info page (nanosecond
+ *           resolution, or 10 ms without a TSC). Returns 0, or -1 on a bad clock or buffer
+ */
+int32_t sys_clock_gettime (int32_t clock_id, timespec_t* ts)
+{
+	uint64_t ns;
+
+	if(clock_id != CLOCK_MONOTONIC)
+		return ERROR;
+	if(!user_buffer_writable(ts, sizeof(timespec_t)))
+		return ERROR;
+
+	ns = kinfo_clock_ns();
+	ts->tv_sec = div64_32(ns, NS_PER_SEC);
+	ts->tv_nsec = (uint32_t)(ns - (uint64_t)ts->tv_sec * NS_PER_SEC);
+	return 0;
+}
+
+/* sys_nanosleep
+ *    INPUT: req - user buffer with the time to sleep
+ *           rem - NULL, or user buffer for the time left (always 0, nothing cuts a sleep short)
+ * FUNCTION: blocks the caller on a kernel timer until the clock passes the deadline. Timers are
+ *           capped at TIMER_IDLE_TICKS, so longer sleeps rearm until the deadline is reached.
+ *           Returns 0, or -1 on a bad buffer or tv_nsec of a second or more
+ */
+int32_t sys_nanosleep (const timespec_t* req, timespec_t* rem)
+{
+	ktimer_t timer;
+	uint64_t deadline, now;
+	uint32_t flags;
+
+	if(!user_buffer_ok(req, sizeof(timespec_t)))
+		return ERROR;
+	if(rem != NULL && !user_buffer_writable(rem, sizeof(timespec_t)))
+		return ERROR;
+	if(req->tv_nsec >= NS_PER_SEC)
+		return ERROR;
+
+	deadline = kinfo_clock_ns() + (uint64_t)req->tv_sec * NS_PER_SEC + req->tv_nsec;
+	timer_init_one(&timer);
+	cli_and_save(flags);
+	while((now = kinfo_clock_ns()) < deadline) {
+		timer_add(&timer, deadline - now);
+		while(!timer.fired) {
+			if(get_group_ptr()->exiting) {
+				timer_del(&timer); // the process ended, the thread halts on its way out
+				restore_flags(flags);
+				return ERROR;
+			}
+			sleep_on(&timer.wait);
+		}
+	}
+	restore_flags(flags);
+
+	if(rem != NULL) {
+		rem->tv_sec = 0;
+		rem->tv_nsec = 0;
+	}
+	return 0;
+}
+
+/* sys_pipe
+ *    INPUT: fds - user array of two descriptors
+ * FUNCTION: makes a pipe, fds[0] gets its read end and fds[1] its write end. Returns 0, or -1 on a
+ *           bad pointer or if descriptors, pipes or memory ran out
+ */
+int32_t sys_pipe (int32_t* fds)
+{
+	PCB* pcb = get_group_ptr();
+	int32_t ends[2], i;
+	pipe_t* pipe;
+
+	if(!user_buffer_writable(fds, 2 * sizeof(int32_t)))
+		return ERROR;
+	for(i = FIRST_NON_STD_FD, ends[0] = ends[1] = -1; i < TOTAL_NUMBER_OF_FILE_DESCRIPTORS; i++) {
+		if(pcb->fd[i].flag)
+			continue;
+		if(ends[0] < 0)
+			ends[0] = i;
+		else {
+			ends[1] = i;
+			break;
+		}
+	}
+	if(ends[1] < 0 || (pipe = pipe_create()) == NULL)
+		return ERROR;
+
+	for(i = 0; i < 2; i++) {
+		pcb->fd[ends[i]].file_d_jump = (i == PIPE_READ_END) ? pipe_read_jump : pipe_write_jump;
+		cursor_init(&pcb->fd[ends[i]].cursor, FILE_START);
+		pcb->fd[ends[i]].cursor.inode = NULL; // not data file
+		pcb->fd[ends[i]].pipe = pipe;
+		pcb->fd[ends[i]].flag = FLAG_SET;
+		fds[i] = ends[i];
+	}
+	return 0;
+}
+
+/* sys_spawn
+ *    INPUT: command - program and arguments, as for execute
+ *           stdin_fd / stdout_fd - the caller's descriptors (terminal or pipe ends) to give the child
+ *                                  as its stdin and stdout
+ * FUNCTION: starts the program next to the caller instead of in its place: the child is queued and
+ *           the caller carries on. Once the child halts it stays a zombie until the caller collects it
+ *           with waitpid (or halts itself). Returns the child's pid, or -1 if the descriptors are
+ *           unsuitable or it can't be started
+ */
+int32_t sys_spawn (const uint8_t* command, int32_t stdin_fd, int32_t stdout_fd)
+{
+	PCB* pcb = get_pcb_ptr();
+	PCB* group = get_group_ptr();
+	PCB* child;
+	int32_t pid, i, fds[2] = {stdin_fd, stdout_fd};
+
+	if((uint32_t*)command >= (uint32_t*)_132MB || (uint32_t*)command < (uint32_t*)_128MB)
+		return ERROR;
+	for(i = 0; i < 2; i++) {
+		if(fds[i] < MIN_FD_INDEX || fds[i] > MAX_FD_INDEX || !group->fd[fds[i]].flag)
+			return ERROR;
+		// only descriptors that can be shared as they are
+		if(group->fd[fds[i]].file_d_jump != stdin_jump && group->fd[fds[i]].file_d_jump != stdout_jump &&
+				group->fd[fds[i]].pipe == NULL)
+			return ERROR;
+	}
+
+	pid = process_create(command, pcb->p_id, -1);
+	if(pid < 0)
+		return ERROR;
+	child = pcb_table[pid];
+	child->spawned = 1;
+	process_inherit_stdio(child, group, stdin_fd, stdout_fd);
+	sched_enqueue(child);
+	return pid;
+}
+
+/* process_copy_pcb
+ *    INPUT: pid - slot claimed for a new task
+ *           parent - task creating it
+ * FUNCTION: fills the new task's PCB from the process 'parent' belongs to (name, arguments,
+ *           terminal, image cursor, descriptors, mmap state) with fresh accounting. The task is
+ *           a spawned child of 'parent' in the same group. Returns the PCB
+ */
+static PCB* process_copy_pcb(int32_t pid, PCB* parent)
+{
+	PCB* task = pcb_table[pid];
+	memcpy(task, pcb_table[parent->group], sizeof(PCB));
+	task->p_id = pid;
+	task->parent = parent->p_id;
+	task->child = -1;
+	task->spawned = 1;
+	task->exit_status = 0;
+	task->level = 0;
+	task->run_ticks = 0;
+	task->user_ticks = 0;
+	task->kernel_ticks = 0;
+	task->nvcsw = 0;
+	task->nivcsw = 0;
+	task->syscalls = 0;
+	task->in_kernel = 0;
+	task->futex_key = 0;
+	task->exiting = 0;
+	wait_queue_init(&task->child_wait);
+	return task;
+}
+
+/* sys_fork
+ *    INPUT: none
+ * FUNCTION: starts a copy of the caller that continues from the same point. Nothing is copied up
+ *           front: the child shares every page, the ones either side writes are copied then (see
+ *           copy_program_page). Descriptors are inherited except rtc ones, which belong to one
+ *           process. The child is collected with waitpid like a spawned one. Returns the child's
+ *           pid to the caller and 0 to the child, or -1 if there is no slot or memory
+ */
+int32_t sys_fork (void)
+{
+	PCB* pcb = get_pcb_ptr();
+	PCB* group = get_group_ptr();
+	PCB* child;
+	int32_t pid;
+	uint32_t flags;
+
+	cli_and_save(flags);
+	pid = process_claim_slot(-1);
+	if(pid == NO_PROCESS_SLOT) {
+		restore_flags(flags);
+		return ERROR;
+	}
+	if(process_paging_fork(group->p_id, pid) == ERROR) {
+		process_array[pid] = 0;
+		printf("Not enough memory to start another program\n");
+		restore_flags(flags);
+		return ERROR;
+	}
+
+	child = process_copy_pcb(pid, pcb);
+	child->group = pid;
+	child->threads = 1;
+	if(child->exe != NULL)
+		child->exe->refcount++; // one more instance, dropped by image_put as it halts
+	process_inherit_fds(child, group);
+
+	sched_prepare_fork(child, pcb);
+	sched_enqueue(child);
+	restore_flags(flags);
+	return pid;
+}
+
+/* sys_thread_create
+ *    INPUT: entry - user address the thread starts at
+ *           stack - top of the user stack it starts with (memory the caller set aside)
+ * FUNCTION: starts another task in the caller's process. It shares the address space and the
+ *           descriptors and has a kernel stack of its own. The thread is collected with waitpid
+ *           like a spawned child. When the process's first task halts the other threads halt too.
+ *           Returns the thread's pid, or -1 on a bad address, if there is no slot or if the
+ *           process is exiting
+ */
+int32_t sys_thread_create (uint32_t entry, uint32_t stack)
+{
+	PCB* pcb = get_pcb_ptr();
+	PCB* group = get_group_ptr();
+	PCB* thread;
+	int32_t pid;
+	uint32_t flags;
+
+	if(entry < _128MB || entry >= _132MB || stack <= _128MB || stack > _132MB)
+		return ERROR;
+
+	cli_and_save(flags);
+	if(group->exiting) {
+		restore_flags(flags);
+		return ERROR;
+	}
+	pid = process_claim_slot(-1);
+	if(pid == NO_PROCESS_SLOT) {
+		restore_flags(flags);
+		return ERROR;
+	}
+	thread = process_copy_pcb(pid, pcb);
+	thread->threads = 0; // counted in the leader
+	group->threads++;
+
+	sched_prepare_task(thread, entry, stack);
+	sched_enqueue(thread);
+	restore_flags(flags);
+	return pid;
+}
+
+/* sys_waitpid
+ *    INPUT: pid - spawned child to wait for, or WAIT_ANY for whichever halts first
+ *           status - NULL, or user buffer for the child's halt status
+ *           options - WNOHANG to return 0 instead of blocking while the child is still running
+ * FUNCTION: collects a zombie child, freeing its slot. Returns the child's pid, 0 under WNOHANG if
+ *           none has halted yet, or -1 if there is no such spawned child (or the buffer is bad)
+ */
+int32_t sys_waitpid (int32_t pid, int32_t* status, int32_t options)
+{
+	PCB* pcb = get_pcb_ptr();
+	PCB* child;
+	int32_t i, found;
+	uint32_t flags;
+
+	if(status != NULL && !user_buffer_writable(status, sizeof(int32_t)))
+		return ERROR;
+
+	cli_and_save(flags);
+	for(;;) {
+		found = 0;
+		for(i = 0; i < MAX_NUM_PROCESSES; i++) {
+			child = pcb_table[i];
+			if(!process_array[i] || child == NULL || !child->spawned || child->parent != pcb->p_id)
+				continue;
+			if(pid != WAIT_ANY && pid != i)
+				continue;
+			found = 1;
+			if(child->state == TASK_ZOMBIE) {
+				if(status != NULL)
+					*status = child->exit_status;
+				process_free_slot(child);
+				restore_flags(flags);
+				return i;
+			}
+		}
+		if(!found || (options & WNOHANG)) {
+			restore_flags(flags);
+			return found ? 0 : ERROR;
+		}
+		if(get_group_ptr()->exiting) {
+			restore_flags(flags);
+			return ERROR; // the process ended, the thread halts on its way out
+		}
+		sleep_on(&pcb->child_wait); // a child's halt wakes us
+	}
+}
+
+/* futex_key_of
+ *    INPUT: addr - aligned word in the running program's page
+ * FUNCTION: returns the physical address of the word, which names it the same way in every task
+ *           that maps its page. A page that is not loaded yet is loaded, and a copy-on-write page
+ *           is copied, so the key is the frame this process really writes. Returns 0 if the page
+ *           can't be had. Interrupts must be off
+ */
+static uint32_t futex_key_of(uint32_t* addr)
+{
+	PCB* pcb = get_pcb_ptr();
+	page_table_desc_t* pte = &program_page_table[pcb->group][((uint32_t)addr - _128MB) / KiB4];
+
+	if(!pte->present && load_program_page((uint32_t)addr) == ERROR)
+		return 0;
+	if((pte->avail & PTE_AVAIL_COW) && copy_program_page((uint32_t)addr) == ERROR)
+		return 0;
+	return (pte->address << 12) | ((uint32_t)addr & (KiB4 - 1)); // shift by 12 to get the frame address back
+}
+
+/* sys_futex
+ *    INPUT: addr - aligned 32 bit word in the program page, shared by the tasks using it
+ *           op - FUTEX_WAIT or FUTEX_WAKE
+ *           val - FUTEX_WAIT: value the caller expects in the word, FUTEX_WAKE: most tasks to wake
+ * FUNCTION: lets user space locks sleep instead of spin. FUTEX_WAIT sleeps until a FUTEX_WAKE on
+ *           the same word, unless the word no longer holds val, and returns 0 (-1 if it did not
+ *           sleep). FUTEX_WAKE returns how many tasks it woke. Returns -1 for a bad word or op
+ */
+int32_t sys_futex (uint32_t* addr, int32_t op, uint32_t val)
+{
+	uint32_t key, flags;
+	int32_t ret;
+
+	if((uint32_t)addr < _128MB || (uint32_t)addr > _132MB - 4 || ((uint32_t)addr & 3))
+		return ERROR;
+	if(op != FUTEX_WAIT && op != FUTEX_WAKE)
+		return ERROR;
+
+	cli_and_save(flags);
+	key = futex_key_of(addr);
+	if(key == 0)
+		ret = ERROR;
+	else if(op == FUTEX_WAIT)
+		ret = futex_wait(key, addr, val);
+	else
+		ret = futex_wake(key, val);
+	restore_flags(flags);
+	return ret;
+}
+
+/* syscall_enter
+ *    INPUT: none
+ * FUNCTION: called by syscallhandle before every system call: counts it and marks the task as
+ *           running kernel code, so ticks from here on are kernel time. With the local APIC timer
+ *           reading the clock is cheap, so the time spent in user mode is charged exactly
+ */
+void syscall_enter(void)
+{
+	PCB* pcb = sched_current;
+	if(pcb == NULL)
+		return; // nothing to charge before the first process starts
+	if(timer_mode == TIMER_APIC_ONESHOT)
+		timer_sync();
+	pcb->syscalls++;
+	pcb->in_kernel = 1;
+}
+
+/* syscall_exit
+ *    INPUT: none
+ * FUNCTION: called by syscallhandle on the way back to user mode, ticks are user time again
+ */
+void syscall_exit(void)
+{
+	PCB* pcb = sched_current;
+	if(pcb == NULL)
+		return;
+	if(timer_mode == TIMER_APIC_ONESHOT)
+		timer_sync();
+	process_exit_pending();
+	pcb->in_kernel = 0;
+}
+
 /* sys_zero
  *    INPUT: none
  * FUNCTION: emtpy handler for syscall 0 , returns 0
@@ -393,6 +989,200 @@ int32_t sys_zero(void)
 
 /*---------- HELPER FUNCTIONS ----------*/
 
+/* image_mark_pages
+ *    INPUT: image - cache entry being built
+ *           segment - PT_LOAD program header
+ *           num_pages - image pages that are whole data blocks of the file
+ *           share - 1 to mark the pages the segment covers shareable, 0 to make them private
+ * FUNCTION: sets or clears the shared bits of every image page that overlaps the segment in memory
+ */
+static void image_mark_pages(exec_image_t* image, elf_phdr_t* segment, uint32_t num_pages, int share)
+{
+	uint32_t start = segment->p_vaddr;
+	uint32_t end = segment->p_vaddr + segment->p_memsz;
+	uint32_t page;
+
+	if(segment->p_memsz == 0 || end <= PROGRAM_IMG_START)
+		return;
+	if(start < PROGRAM_IMG_START)
+		start = PROGRAM_IMG_START;
+	for(page = (start - PROGRAM_IMG_START) / KiB4; page < num_pages && PROGRAM_IMG_START + page * KiB4 < end; page++) {
+		if(share)
+			image->shared[page / 32] |= 1u << (page % 32);
+		else
+			image->shared[page / 32] &= ~(1u << (page % 32));
+	}
+}
+
+/* image_get
+ *    INPUT: inode - inode of the executable
+ *           header - its ELF header (ELF_HEADER_SIZE bytes)
+ * FUNCTION: returns the image cache entry for 'inode' with its refcount raised, parsing the program
+ *           headers only the first time the program runs. A page is shared if it is a whole data block
+ *           of the file and every segment touching it is read-only. Returns NULL if every entry is in use
+ */
+exec_image_t* image_get(uint32_t inode, const uint8_t* header)
+{
+	exec_image_t* image = NULL;
+	elf_phdr_t segment;
+	file_cursor_t cursor;
+	uint32_t i, phoff, phnum, num_pages;
+	int pass;
+
+	for(i = 0; i < IMAGE_CACHE_SIZE; i++) {
+		if(image_cache[i].valid && image_cache[i].inode_num == inode) {
+			image_cache[i].refcount++;
+			return &image_cache[i];
+		}
+	}
+	// miss: take an empty entry, or else one no running process uses
+	for(i = 0; i < IMAGE_CACHE_SIZE && image == NULL; i++) {
+		if(!image_cache[i].valid)
+			image = &image_cache[i];
+	}
+	for(i = 0; i < IMAGE_CACHE_SIZE && image == NULL; i++) {
+		if(image_cache[i].refcount == 0)
+			image = &image_cache[i];
+	}
+	if(image == NULL)
+		return NULL;
+
+	memset(image, 0, sizeof(exec_image_t));
+	image->inode_num = inode;
+	image->refcount = 1;
+	image->valid = 1;
+
+	// data blocks can only be mapped into user space if they sit on page boundaries
+	if(!fs_blocks_page_aligned())
+		return image;
+
+	cursor_init(&cursor, inode);
+	num_pages = cursor.inode->length_in_bytes / KiB4; // a partial last block holds bytes past the end of the file
+	if(num_pages > MAX_IMAGE_PAGES)
+		num_pages = MAX_IMAGE_PAGES;
+	phoff = *((uint32_t*)(header + ELF_PHOFF_OFFSET));
+	phnum = *((uint16_t*)(header + ELF_PHNUM_OFFSET));
+	if(phnum > ELF_MAX_PHDRS)
+		phnum = ELF_MAX_PHDRS;
+
+	// pass 0 marks read-only segments, pass 1 takes back any page a writable segment also touches
+	for(pass = 0; pass < 2; pass++) {
+		for(i = 0; i < phnum; i++) {
+			if(read_data(inode, phoff + i * sizeof(elf_phdr_t), (uint8_t*)&segment, sizeof(elf_phdr_t)) != sizeof(elf_phdr_t))
+				break;
+			if(segment.p_type != PT_LOAD)
+				continue;
+			if(pass == 0 && !(segment.p_flags & PF_W))
+				image_mark_pages(image, &segment, num_pages, 1);
+			else if(pass == 1 && (segment.p_flags & PF_W))
+				image_mark_pages(image, &segment, num_pages, 0);
+		}
+	}
+	return image;
+}
+
+/* image_put
+ *    INPUT: image - cache entry returned by image_get (may be NULL)
+ * FUNCTION: drops a reference; the entry stays cached for the next run of the program
+ */
+void image_put(exec_image_t* image)
+{
+	if(image != NULL && image->refcount > 0)
+		image->refcount--;
+}
+
+/* load_program_page
+ *    INPUT: address - faulting virtual address (from cr2)
+ * FUNCTION: demand loader called by the page fault handler. If 'address' is in a not-present
+ *           page of the running program, maps the page, zeroes it and copies in the part of the
+ *           executable that lives there (the image is mapped flat at PROGRAM_IMG_START).
+ *           Returns 0 if the access can be retried, -1 if it is a real fault
+ */
+int32_t load_program_page(uint32_t address)
+{
+	uint32_t entry, page, file_offset, length, frame, flags;
+	int32_t bytes_read = 0;
+	page_table_desc_t* pte;
+
+	if(address < _128MB || address >= _132MB)
+		return ERROR;
+	PCB* pcb = get_pcb_ptr(); // a thread reads through its own copy of the image cursor
+	entry = (address - _128MB) / KiB4;
+	page = address & ~(KiB4 - 1);
+	pte = &program_page_table[pcb->group][entry];
+
+	// other threads of the process must not see the page before it is filled
+	cli_and_save(flags);
+	if(pte->present) {
+		restore_flags(flags);
+		return ERROR;
+	}
+
+	frame = frame_alloc();
+	if(frame == 0) {
+		restore_flags(flags);
+		return ERROR; // out of memory
+	}
+	// not-present entries are never cached in the TLB, so no flush is needed here
+	pte->address = frame >> 12; // shift by 12 to remove non-address bits
+	pte->avail = PTE_AVAIL_FRAME;
+	pte->present = 1;
+
+	length = pcb->image.inode->length_in_bytes;
+	if(page >= PROGRAM_IMG_START && page - PROGRAM_IMG_START < length) {
+		file_offset = page - PROGRAM_IMG_START;
+		cursor_seek(&pcb->image, file_offset);
+		bytes_read = cursor_read(&pcb->image, (uint8_t*)page, KiB4);
+		if(bytes_read < 0)
+			bytes_read = 0;
+	}
+	// the rest of the page (bss, stack, or past the end of the file) starts zeroed
+	memset((uint8_t*)page + bytes_read, 0, KiB4 - bytes_read);
+	restore_flags(flags);
+	return 0;
+}
+
+/* copy_program_page
+ *    INPUT: address - faulting virtual address (from cr2) of a write to a present page
+ * FUNCTION: called by the page fault handler. If 'address' is in a copy-on-write page of the
+ *           running program, the last process sharing the frame gets write access back and the
+ *           others copy it into a frame of their own first.
+ *           Returns 0 if the access can be retried, -1 if it is a real fault
+ */
+int32_t copy_program_page(uint32_t address)
+{
+	uint32_t entry, page, frame, flags;
+	page_table_desc_t * pte;
+
+	if(address < _128MB || address >= _132MB)
+		return ERROR;
+	PCB* pcb = get_pcb_ptr();
+	entry = (address - _128MB) / KiB4;
+	page = address & ~(KiB4 - 1);
+	pte = &program_page_table[pcb->group][entry];
+
+	cli_and_save(flags);
+	if(!pte->present || !(pte->avail & PTE_AVAIL_COW)) {
+		restore_flags(flags);
+		return ERROR;
+	}
+	if(frame_refcount(pte->address << 12) > 1) { // shift by 12 to get the frame address back
+		frame = frame_alloc();
+		if(frame == 0) {
+			restore_flags(flags);
+			return ERROR; // out of memory
+		}
+		memcpy((uint8_t*)frame, (uint8_t*)page, KiB4); // through the kernel's direct map
+		frame_free(pte->address << 12); // one user fewer for the shared frame
+		pte->address = frame >> 12; // shift by 12 to remove non-address bits
+	}
+	pte->avail = PTE_AVAIL_FRAME;
+	pte->read_write = 1;
+	invlpg(page); // the read-only entry is cached
+	restore_flags(flags);
+	return 0;
+}
+
 /* process_start_file_d
  *    INPUT: *process_fds: array of file descriptors to modify
  * FUNCTION: setup STDIN and STDOUT to the first 2 fd
@@ -402,18 +1192,174 @@ void process_start_file_d(file_d *process_fds)
 	int i;
 		// stdin
 	process_fds[STDIN].file_d_jump = stdin_jump;
-	process_fds[STDIN].inode_num = NULL; // not data file
-	process_fds[STDIN].file_pos = FILE_START;
+	cursor_init(&process_fds[STDIN].cursor, FILE_START);
+	process_fds[STDIN].cursor.inode = NULL; // not data file
 	process_fds[STDIN].flag = FLAG_SET; // in use
 		// stdout  
 	process_fds[STDOUT].file_d_jump = stdout_jump;
-	process_fds[STDOUT].inode_num = NULL; // not data file
-	process_fds[STDOUT].file_pos = FILE_START;
+	cursor_init(&process_fds[STDOUT].cursor, FILE_START);
+	process_fds[STDOUT].cursor.inode = NULL; // not data file
 	process_fds[STDOUT].flag = FLAG_SET; // in use
 
 	for(i = FIRST_NON_STD_FD; i < TOTAL_NUMBER_OF_FILE_DESCRIPTORS; i++ )
 		process_fds[i].flag = FLAG_UNSET;
+	for(i = 0; i < TOTAL_NUMBER_OF_FILE_DESCRIPTORS; i++ )
+		process_fds[i].pipe = NULL;
+
+}
+
+/* process_inherit_stdio
+ *    INPUT: child - process just made by process_create
+ *           parent - process starting it
+ *           stdin_fd / stdout_fd - descriptors of 'parent' to become the child's stdin and stdout
+ * FUNCTION: copies the two descriptors into the child, a pipe end counts one more user
+ */
+void process_inherit_stdio(PCB* child, PCB* parent, int32_t stdin_fd, int32_t stdout_fd)
+{
+	child->fd[STDIN] = parent->fd[stdin_fd];
+	child->fd[STDOUT] = parent->fd[stdout_fd];
+	if(child->fd[STDIN].pipe != NULL)
+		pipe_get(child->fd[STDIN].pipe, child->fd[STDIN].file_d_jump == pipe_read_jump ? PIPE_READ_END : PIPE_WRITE_END);
+	if(child->fd[STDOUT].pipe != NULL)
+		pipe_get(child->fd[STDOUT].pipe, child->fd[STDOUT].file_d_jump == pipe_read_jump ? PIPE_READ_END : PIPE_WRITE_END);
+}
+
+/* process_inherit_fds
+ *    INPUT: child - process made by fork, its descriptors copied from 'parent'
+ *           parent - process forking
+ * FUNCTION: settles the copied descriptors: pipe ends count one more user, rtc descriptors are
+ *           closed in the child since their virtual rtc belongs to the parent's slot
+ */
+void process_inherit_fds(PCB* child, PCB* parent)
+{
+	int32_t i;
+	for(i = 0; i < TOTAL_NUMBER_OF_FILE_DESCRIPTORS; i++) {
+		if(!parent->fd[i].flag)
+			continue;
+		if(parent->fd[i].file_d_jump == rtc_jump)
+			child->fd[i].flag = FLAG_UNSET;
+		else if(parent->fd[i].pipe != NULL)
+			pipe_get(parent->fd[i].pipe, parent->fd[i].file_d_jump == pipe_read_jump ? PIPE_READ_END : PIPE_WRITE_END);
+	}
+}
+
+/* process_close_fd
+ *    INPUT: pcb - the current process
+ *           fd - descriptor to close, stdin and stdout included
+ * FUNCTION: closes an open descriptor as the process halts (sys_close keeps 0 and 1 open)
+ */
+void process_close_fd(PCB* pcb, int32_t fd)
+{
+	uint32_t (*fd_close)(int32_t fd);
+	if(!pcb->fd[fd].flag)
+		return;
+	fd_close = (void*)pcb->fd[fd].file_d_jump[FILE_OP_CLOSE];
+	pcb->fd[fd].flag = FLAG_UNSET;
+	fd_close(fd);
+}
+
+/* process_orphan_children
+ *    INPUT: pcb - process that is halting
+ * FUNCTION: frees its spawned children that are already zombies, the rest lose their parent and
+ *           free their own slot when they halt
+ */
+void process_orphan_children(PCB* pcb)
+{
+	PCB* child;
+	int32_t i;
+	for(i = 0; i < MAX_NUM_PROCESSES; i++) {
+		child = pcb_table[i];
+		if(!process_array[i] || child == NULL || !child->spawned || child->parent != pcb->p_id)
+			continue;
+		if(child->state == TASK_ZOMBIE)
+			process_free_slot(child);
+		else
+			child->parent = -1;
+	}
+}
+
+/* process_free_slot
+ *    INPUT: task - halted task that has been collected (or has nobody to collect it)
+ * FUNCTION: marks the task unused and frees its slot. A group leader whose threads are still
+ *           running keeps the slot, they use its PCB, until process_group_done
+ */
+void process_free_slot(PCB* task)
+{
+	task->state = TASK_UNUSED;
+	task->spawned = 0; // nothing for waitpid to collect any more
+	if(task->threads == 0)
+		process_array[task->p_id] = 0;
+}
+
+/* process_exit_threads
+ *    INPUT: leader - group leader that is halting while other threads run
+ *           status - its halt status, which the threads halt with too
+ * FUNCTION: marks the process exiting so each thread halts on its next return to user space (see
+ *           process_exit_pending). Threads asleep in the kernel are woken for that: every sleep
+ *           loop a thread can be in gives up with an error once its process is exiting
+ */
+void process_exit_threads(PCB* leader, uint8_t status)
+{
+	PCB* task;
+	int32_t i;
+
+	leader->exiting = 1;
+	leader->exit_status = status;
+	for(i = 0; i < MAX_NUM_PROCESSES; i++) {
+		task = pcb_table[i];
+		if(!process_array[i] || task == NULL || task == leader || task->group != leader->p_id)
+			continue;
+		// on a wait queue; one blocked in execute is resumed by its child's halt instead
+		if(task->state == TASK_BLOCKED && task->node.next != NULL)
+			wake_up_task(task);
+	}
+}
+
+/* process_release
+ *    INPUT: group - group leader of a process whose last task is halting
+ * FUNCTION: closes the descriptors (stdin and stdout too, they may be pipe ends) and gives back
+ *           the address space (the kernel directory is loaded in its place)
+ */
+void process_release(PCB* group)
+{
+	int32_t j;
 
+	for(j = 0; j < TOTAL_NUMBER_OF_FILE_DESCRIPTORS; j++)
+		process_close_fd(group, j);
+	image_put(group->exe);
+	group->exe = NULL;
+	process_paging_free(group->p_id);
+}
+
+/* process_group_done
+ *    INPUT: group - group leader that halted before its last thread, which is halting now
+ * FUNCTION: frees the leader's slot if it was collected while the threads ran, or starts the new
+ *           shell of a root shell in it. A leader still waiting to be collected keeps its slot
+ */
+void process_group_done(PCB* group)
+{
+	if(group->state == TASK_UNUSED) {
+		process_array[group->p_id] = 0;
+	}
+	else if(group->state == TASK_ZOMBIE && group->parent < 0 && !group->spawned) {
+		if(process_create((uint8_t*)"shell", -1, group->p_id) == group->p_id)
+			sched_enqueue(group);
+		else
+			process_array[group->p_id] = 0;
+	}
+}
+
+/* process_exit_pending
+ *    INPUT: none
+ * FUNCTION: halts the running task if its process is exiting. Called on the way back to user space
+ *           (syscall_exit, and the timer interrupt when it came from user space), where the task
+ *           holds nothing in the kernel
+ */
+void process_exit_pending(void)
+{
+	PCB* pcb = sched_current;
+	if(pcb != NULL && pcb_table[pcb->group]->exiting)
+		sys_halt(pcb_table[pcb->group]->exit_status);
 }
 
 /* get_pcb_ptr
@@ -432,13 +1378,34 @@ PCB* get_pcb_ptr(void)
 	return pcb_addr;
 }
 
+/* get_pcb_by_pid
+ *    INPUT: pid - process slot
+ * FUNCTION: get pointer to the pcb of process 'pid', NULL if the slot has never had a kernel stack
+ */
+PCB* get_pcb_by_pid(int32_t pid)
+{
+	if(pid < 0 || pid >= MAX_NUM_PROCESSES)
+		return NULL;
+	return pcb_table[pid];
+}
+
+/* get_group_ptr
+ *    INPUT: None
+ * FUNCTION: get pointer to the pcb of the process the current task belongs to, which holds the
+ *           descriptors and address space (the task itself unless it is a thread)
+ */
+PCB* get_group_ptr()
+{
+	return pcb_table[get_pcb_ptr()->group];
+}
+
 /* get_available_fd
  *    INPUT: return_file_descriptor_index: 
  * FUNCTION: gets next available file descriptors
  */
 file_d* get_available_fd(uint32_t* return_file_descriptor_index)
 {
-	PCB* current_pcb = get_pcb_ptr();
+	PCB* current_pcb = get_group_ptr();
 	uint32_t file_descriptor_index; //stdin and stdout always take spots 0 and 1
 	for(file_descriptor_index=FIRST_NON_STD_FD;file_descriptor_index<TOTAL_NUMBER_OF_FILE_DESCRIPTORS; file_descriptor_index++)
 	{
@@ -4,9 +4,15 @@
 #include "x86_desc.h"
 #include "filesystem.h"
 #include "paging.h"
+#include "frame.h"
+#include "sched.h"
+#include "switch.h"
+#include "kinfo.h"
 #include "lib.h"
 #include "drivers/terminal.h"
 #include "drivers/rtc.h"
+#include "drivers/pipe.h"
+#include "futex.h"
 // various constants
 #define FILE_SIZE 32
 #define FIRST_NON_STD_FD 2
@@ -20,8 +26,13 @@
 #define MIN_FD_INDEX 0
 
 #define INITIAL_PID 0
+#define WAIT_ANY -1 // sys_waitpid: any spawned child
+#define WNOHANG 1 // sys_waitpid option: don't block
+#define NO_PROCESS_SLOT -2 // process_create: out of pid slots or memory (execute reports it and returns 0)
+#define NUM_ROOT_SHELLS 3 // one per terminal, pids 0 - 2
 #define FIRST_PROCESS_PID 0
-#define MAX_NUM_PROCESSES 6
+#define MAX_NUM_PROCESSES 32 // pid slots, the real limit is how many kernel stacks and page tables fit in memory
+#define KERNEL_STACK_FRAMES 2 // 8 KB kernel stack per process, PCB at the bottom
 
 #define NUM_FILE_OPS 4
 #define FILE_OP_OPEN 0
@@ -39,12 +50,25 @@
 #define _128MB  0x8000000
 #define _132MB  0x8400000
 #define IMAGE_OFFSET 0x48000
+#define ELF_HEADER_SIZE 52 // the whole ELF32 file header
+#define ELF_ENTRY_OFFSET 24
+#define ELF_PHOFF_OFFSET 28 // file offset of the program header table
+#define ELF_PHNUM_OFFSET 44 // 16-bit count of program headers
+#define ELF_MAX_PHDRS 16 // more than any of our programs have, bounds a corrupt header
+#define PT_LOAD 1
+#define PF_W 0x2 // segment is writable
 #define PROGRAM_IMG_START _128MB + IMAGE_OFFSET
 
+// executable image cache
+#define IMAGE_CACHE_SIZE 8 // distinct programs whose layout is remembered, extra programs just don't share
+#define IMAGE_FIRST_ENTRY (IMAGE_OFFSET / 0x1000) // program page table entry holding the first image page
+#define MAX_IMAGE_PAGES (1024 - IMAGE_FIRST_ENTRY) // image pages below the top of the 4 MB program page
+#define IMAGE_BITMAP_WORDS ((MAX_IMAGE_PAGES + 31) / 32)
+
 
 
 /*  
- syscalls 0 - 10
+ syscalls 0 - 20
  */ 
  int32_t sys_zero();
  int32_t sys_halt (uint8_t status);
@@ -57,20 +81,67 @@
  int32_t sys_vidmap (uint8_t** screen_start);
  int32_t sys_set_handler (int32_t signum, void* handler);
  int32_t sys_sigreturn (void);
+ int32_t sys_mmap (int32_t fd, uint8_t** start);
+ int32_t sys_stats (int32_t pid, void* buf);
+ struct timespec;
+ int32_t sys_clock_gettime (int32_t clock_id, struct timespec* ts);
+ int32_t sys_nanosleep (const struct timespec* req, struct timespec* rem);
+ int32_t sys_pipe (int32_t* fds);
+ int32_t sys_spawn (const uint8_t* command, int32_t stdin_fd, int32_t stdout_fd);
+ int32_t sys_waitpid (int32_t pid, int32_t* status, int32_t options);
+ int32_t sys_fork (void);
+ int32_t sys_thread_create (uint32_t entry, uint32_t stack);
+ int32_t sys_futex (uint32_t* addr, int32_t op, uint32_t val);
+
+/* fills a not-present page of the running program on first touch */
+int32_t load_program_page(uint32_t address);
+/* gives the running program its own copy of a copy-on-write page on a write */
+int32_t copy_program_page(uint32_t address);
+
+/* ELF32 program header, only PT_LOAD entries are looked at */
+typedef struct __attribute__((packed)) elf_phdr {
+	uint32_t p_type;
+	uint32_t p_offset;
+	uint32_t p_vaddr;
+	uint32_t p_paddr;
+	uint32_t p_filesz;
+	uint32_t p_memsz;
+	uint32_t p_flags;
+	uint32_t p_align;
+} elf_phdr_t;
+
+/*
+exec_image: (executable image cache entry, one per program inode)
+1. inode_num : inode of the executable
+2. refcount : running instances of the program, only unused entries are replaced
+3. valid : entry holds a parsed image
+4. shared : bit i set if image page i only holds read-only segments (text/rodata), so every
+            instance maps the page straight onto the file's data block instead of copying it
+*/
+typedef struct exec_image {
+	uint32_t inode_num;
+	uint32_t refcount;
+	uint32_t valid;
+	uint32_t shared[IMAGE_BITMAP_WORDS];
+} exec_image_t;
+
+exec_image_t* image_get(uint32_t inode, const uint8_t* header);
+void image_put(exec_image_t* image);
 
 
 /*
 file_d: (file descriptor)
 1. file_d_jump : jumptable for open,read,write,close
-2. inode_num : 0 for dir and RTC dev file
-3. file_pos : file position. read should update this
-4. flag : flag to mark as in-use
+2. cursor : open-file cursor (inode, file position, cached data block).
+            inode is NULL for dir, RTC and terminal. read should update this
+3. flag : flag to mark as in-use
+4. pipe : pipe behind a pipe end, NULL otherwise
 */
 typedef struct __attribute__((packed)) file_descrip {
 	uint32_t *file_d_jump;
-	uint32_t inode_num;
-	uint32_t file_pos;
+	file_cursor_t cursor;
 	uint32_t flag; // 1 for in use, 0 for not in use
+	pipe_t *pipe;
 } file_d;
 
 void process_start_file_d(file_d *process_fds);
@@ -78,38 +149,133 @@ void process_start_file_d(file_d *process_fds);
 
 /*
 PCB:
-1. esp : stack pointer for process
-2. ebp : base pointer for process
-3. eflags : flags for process
-4  p_id : process id
-5. parent : ptr to parent process
-6. child : ptr to child process
-7  fd : list of file descriptors for open files
-8  args : arguments for process
-9  size_args : size of argument(s)
-10 registers : used to save more registers if process paused from scheduling
-	 	0:EAX 1:EBX 2:ECX 3:EDX 4:ESI 5:EDI
+1. context : kernel registers saved while the task is switched out (switch.h)
+2  p_id : process id
+3. parent : ptr to parent process
+4. child : ptr to child process
+5  fd : list of file descriptors for open files
+6  args : arguments for process
+7  size_args : size of argument(s)
+8  mmap_next : next free entry of the process's user page table for mmap
+9  image : cursor over the executable, used to load program pages on demand
+10 exe : image cache entry of the executable (NULL if the cache was full)
+11 state : TASK_RUNNABLE, TASK_BLOCKED or TASK_ZOMBIE (sched.h)
+12 node : link on the run queue or on the wait queue the task sleeps on
+13 exit_status : value returned to the parent's execute once the task halts
+14 run_ticks : PIT ticks that found this task on the cpu
+15 terminal : terminal the task belongs to (pid of its root shell)
+16 level : multilevel feedback queue level, 0 is the highest priority
+17 user_ticks / kernel_ticks : run_ticks split by whether the task was inside a system call
+18 nvcsw / nivcsw : voluntary (blocked or halted) and involuntary (preempted) context switches
+19 syscalls : system calls made
+20 in_kernel : set between system call entry and exit (syshandler.S)
+21 name : program file name
+22 spawned : started by spawn or fork, the parent keeps running and collects it with waitpid (parent is -1
+              once the parent has halted, the slot is then freed as soon as the child halts)
+23 child_wait : the task sleeps here in waitpid, its spawned children wake it as they halt
+24 group : pid of the process whose address space and descriptors the task uses, its own pid unless
+           it is a thread made by thread_create
+25 threads : tasks of the group that have not halted, counted in the group leader (1 without threads,
+             0 in a thread)
+26 futex_key : physical address of the futex word the task sleeps on in futex_wait, 0 when not asleep there
+27 exiting : set in the group leader once it has halted, its threads halt on their way back to user space
 */
 typedef struct __attribute__((packed)) PCB_struct {
-	uint32_t esp_halt;
-	uint32_t ebp_halt;
-	uint32_t esp;
-	uint32_t ebp;
-	uint32_t eflags;
-	uint32_t eip;
+	cpu_context_t context;
 	uint32_t p_id;
 	int32_t parent;
 	int32_t child;
 	file_d fd[TOTAL_NUMBER_OF_FILE_DESCRIPTORS];
 	uint8_t args[ARG_SIZE];
 	uint32_t size_args;
+	uint32_t mmap_next;
+	file_cursor_t image;
+	exec_image_t* exe;
+	uint32_t state;
+	sched_node_t node;
+	int32_t exit_status;
+	uint32_t run_ticks;
+	int32_t terminal;
+	uint32_t level;
+	uint32_t user_ticks;
+	uint32_t kernel_ticks;
+	uint32_t nvcsw;
+	uint32_t nivcsw;
+	uint32_t syscalls;
+	uint32_t in_kernel;
+	uint8_t name[FILE_SIZE];
+	uint32_t spawned;
+	wait_queue_t child_wait;
+	uint32_t group;
+	uint32_t threads;
+	uint32_t futex_key;
+	uint32_t exiting;
 } PCB;
 
-int process_array[6]; // 0 = unused, 1 = running
-PCB control_block[6];
+#define STATS_SYSTEM -1 // sys_stats pid that asks for sys_stat_t instead of proc_stat_t
+
+/*
+proc_stat: (what sys_stats reports for one process, same layout as in ece391syscall.h)
+*/
+typedef struct proc_stat {
+	int32_t pid;
+	int32_t parent;
+	int32_t terminal;
+	uint32_t state;
+	uint32_t level;
+	uint32_t user_ticks;
+	uint32_t kernel_ticks;
+	uint32_t nvcsw;
+	uint32_t nivcsw;
+	uint32_t syscalls;
+	uint8_t name[FILE_SIZE + 1];
+} proc_stat_t;
+
+/*
+sys_stat: (what sys_stats reports for the whole system, same layout as in ece391syscall.h)
+*/
+typedef struct sys_stat {
+	uint32_t ticks;
+	uint32_t idle_ticks;
+	uint32_t timer_interrupts;
+	uint32_t policy;
+	uint32_t frames_free;
+	uint32_t frames_total;
+} sys_stat_t;
+
+#define CLOCK_MONOTONIC 1 // sys_clock_gettime clock: time since boot
+#define NS_PER_SEC 1000000000
+
+/*
+timespec: (seconds and nanoseconds for sys_clock_gettime and sys_nanosleep, same layout as in ece391syscall.h)
+*/
+typedef struct timespec {
+	uint32_t tv_sec;
+	uint32_t tv_nsec;
+} timespec_t;
+
+void syscall_enter(void);
+void syscall_exit(void);
+
+int process_array[MAX_NUM_PROCESSES]; // 0 = unused, 1 = running
+PCB* pcb_table[MAX_NUM_PROCESSES]; // kernel stack (PCB at the bottom) of each pid slot, kept for reuse once allocated
 
 
 // Helper Functions
+int32_t process_create(const uint8_t* command, int32_t parent, int32_t pid);
+void process_start_shells(void);
+void process_inherit_stdio(PCB* child, PCB* parent, int32_t stdin_fd, int32_t stdout_fd);
+void process_inherit_fds(PCB* child, PCB* parent);
+void process_close_fd(PCB* pcb, int32_t fd);
+void process_orphan_children(PCB* pcb);
+int user_buffer_writable(void* buf, uint32_t size);
+void process_free_slot(PCB* task);
+void process_exit_threads(PCB* leader, uint8_t status);
+void process_release(PCB* group);
+void process_group_done(PCB* group);
+void process_exit_pending(void);
 PCB* get_pcb_ptr();
+PCB* get_group_ptr();
+PCB* get_pcb_by_pid(int32_t pid);
 file_d* get_available_fd(uint32_t* return_file_descriptor_index);
 #endif
@@ -1,10 +1,23 @@
 #ifndef _syshandler_H
 #define _syshandler_H
 
+#define MAX_SYSCALL_NUM 20 // highest valid system call number
+
+#define CPUID_EDX_SEP (1 << 11) // cpu has sysenter/sysexit
+#define IA32_SYSENTER_CS 0x174 // kernel cs for sysenter, ss = cs + 8, sysexit uses cs + 16 and cs + 24
+#define IA32_SYSENTER_ESP 0x175 // stack pointer loaded by sysenter
+#define IA32_SYSENTER_EIP 0x176 // kernel entry point for sysenter
+
 #ifndef ASM
 
 #include "syscalls.h"
 
 extern void syscallhandle();
+/* fast system call entry, see sysenter_init */
+extern void sysenter_entry();
+/* program the sysenter MSRs if the cpu supports them */
+void sysenter_init(void);
+
+int sysenter_enabled; // 1 once the MSRs point at sysenter_entry
 #endif
 #endif
@@ -176,6 +176,30 @@ ece391_vidmap (uint8_t** screen_start)
     return 0;
 }
 
+int32_t 
+ece391_mmap (int32_t fd, uint8_t** start)
+{
+    off_t length;
+    void* image;
+
+    if ((NULL != dir && dir_fd == fd) ||
+        -1 == (length = lseek (fd, 0, SEEK_END)) || 
+        -1 == lseek (fd, 0, SEEK_SET))
+        return -1;
+    if (0 == length) {
+        *start = NULL;
+        return 0;
+    }
+    if ((image = mmap ((void*)0, length, PROT_READ, MAP_PRIVATE, fd, 0)) 
+            == MAP_FAILED) {
+        perror ("mmap file");
+        return -1;
+    }
+
+    *start = (uint8_t*)image;
+    return length;
+}
+
 int32_t 
 ece391_read (int32_t fd, void* buf, int32_t nbytes)
 {
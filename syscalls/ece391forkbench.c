@@ -0,0 +1,90 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define ROUNDS 50
+#define PAGE_SIZE 4096
+#define DIRTY_PAGES 64
+#define ARGSIZE 32
+
+/* written once before timing so every page owns a frame that fork has to share */
+static uint8_t data[DIRTY_PAGES * PAGE_SIZE];
+
+/* Child of the "fork + write" rounds: dirty every data page, then halt */
+static void dirty_pages (void)
+{
+    int32_t i;
+
+    for (i = 0; i < DIRTY_PAGES; i++)
+        data[i * PAGE_SIZE]++;
+}
+
+/*
+ * Time ROUNDS runs of one way of starting a child that does next to
+ * nothing and reaping it, and return the microseconds per run (0 on
+ * error).  how is 0 for spawn, 1 for fork, 2 for fork with the child
+ * writing every data page and 3 for fork with the child executing the
+ * program (fork + exec).
+ */
+static uint32_t time_start (int32_t how, uint32_t mhz)
+{
+    int32_t i, pid, status;
+    uint64_t start;
+
+    start = ece391_rdtsc ();
+    for (i = 0; i < ROUNDS; i++) {
+        if (0 == how)
+            pid = ece391_spawn ((uint8_t*)"forkbench -x", 0, 1);
+        else if (0 == (pid = ece391_fork ())) {
+            if (2 == how)
+                dirty_pages ();
+            else if (3 == how)
+                ece391_halt (ece391_execute ((uint8_t*)"forkbench -x"));
+            ece391_halt (0);
+        }
+        if (-1 == pid || pid != ece391_waitpid (pid, &status, 0) || 0 != status)
+            return 0;
+    }
+    return ece391_cycles_to_us (ece391_rdtsc () - start, mhz) / ROUNDS;
+}
+
+/*
+ * forkbench: compare starting a process by loading its program (spawn,
+ * and fork followed by execute in the child) with fork, which copies
+ * nothing until a page is written.  The "fork + write" child writes
+ * DIRTY_PAGES pages, so its extra cost over a plain fork is the price of
+ * copying them.
+ */
+int main ()
+{
+    static const char* labels[4] = {
+        "spawn:          ", "fork:           ", "fork + write:   ", "fork + execute: "
+    };
+    uint32_t us[4], mhz;
+    int32_t i;
+    uint8_t args[ARGSIZE];
+
+    if (0 == ece391_getargs (args, ARGSIZE) && 0 == ece391_strcmp (args, (uint8_t*)"-x"))
+        return 0;
+
+    if (0 == (mhz = ece391_tsc_mhz ())) {
+        ece391_fdputs (1, (uint8_t*)"tsc calibration failed\n");
+        return 3;
+    }
+
+    dirty_pages ();
+    for (i = 0; i < 4; i++) {
+        if (0 == (us[i] = time_start (i, mhz))) {
+            ece391_fdputs (1, (uint8_t*)"starting a child failed\n");
+            return 3;
+        }
+        ece391_print_stat (labels[i], us[i]);
+        ece391_fdputs (1, (uint8_t*)" us\n");
+    }
+    if (us[2] > us[1]) {
+        ece391_print_stat ("copy on write:  ", (us[2] - us[1]) * 1000 / DIRTY_PAGES);
+        ece391_fdputs (1, (uint8_t*)" ns per page written\n");
+    }
+    return 0;
+}
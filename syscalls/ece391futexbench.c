@@ -0,0 +1,145 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define NUM_THREADS 4
+#define ITERS 20000
+#define HOLD_LOOPS 200
+#define PINGPONG_ROUNDS 1000
+#define STACK_SIZE 8192
+
+static uint8_t stacks[NUM_THREADS][STACK_SIZE];
+
+static struct ece391_mutex mutex;
+static volatile uint32_t spinlock;
+static volatile uint32_t counter;
+
+static struct ece391_cond turn_changed;
+static volatile uint32_t turn;
+
+/* Some work inside the critical section, so the holder is sometimes preempted there */
+static void hold (void)
+{
+    volatile int32_t i;
+
+    for (i = 0; i < HOLD_LOOPS; i++);
+}
+
+/* Worker: ITERS increments of counter under the futex mutex */
+static int32_t mutex_worker (void* arg)
+{
+    int32_t i;
+
+    for (i = 0; i < ITERS; i++) {
+        ece391_mutex_lock (&mutex);
+        counter++;
+        hold ();
+        ece391_mutex_unlock (&mutex);
+    }
+    return 0;
+}
+
+/* Worker: the same under a lock that only spins */
+static int32_t spin_worker (void* arg)
+{
+    int32_t i;
+    uint32_t taken;
+
+    for (i = 0; i < ITERS; i++) {
+        do {
+            taken = 1;
+            asm volatile ("xchgl %0, %1" : "+r" (taken), "+m" (spinlock) : : "memory");
+        } while (0 != taken);
+        counter++;
+        hold ();
+        spinlock = 0;
+    }
+    return 0;
+}
+
+/* Ping-pong side *arg: wait for its turn, hand the turn to the other side */
+static int32_t pingpong (void* arg)
+{
+    uint32_t me = *(uint32_t*)arg;
+    int32_t i;
+
+    for (i = 0; i < PINGPONG_ROUNDS; i++) {
+        ece391_mutex_lock (&mutex);
+        while (turn != me)
+            ece391_cond_wait (&turn_changed, &mutex);
+        turn = 1 - me;
+        ece391_cond_signal (&turn_changed);
+        ece391_mutex_unlock (&mutex);
+    }
+    return 0;
+}
+
+/*
+ * Run fn(args[i]) in count threads and wait for all of them.  Returns the
+ * microseconds it took, 0 on error.
+ */
+static uint32_t run_threads (int32_t (*fn)(void*), void** args, int32_t count, uint32_t mhz)
+{
+    int32_t pids[NUM_THREADS], i, status;
+    uint64_t start;
+
+    start = ece391_rdtsc ();
+    for (i = 0; i < count; i++) {
+        if (-1 == (pids[i] = ece391_thread_start (fn, args[i], stacks[i], STACK_SIZE)))
+            return 0;
+    }
+    for (i = 0; i < count; i++)
+        ece391_waitpid (pids[i], &status, 0);
+    return ece391_cycles_to_us (ece391_rdtsc () - start, mhz);
+}
+
+/*
+ * futexbench: NUM_THREADS threads bump one counter under a futex mutex
+ * and under a spinlock.  A spinner whose lock holder was preempted burns
+ * its whole quantum, a futex waiter sleeps until the holder lets go.
+ * Then two threads hand a turn back and forth through a condition
+ * variable.
+ */
+int main ()
+{
+    static uint32_t sides[NUM_THREADS] = {0, 1, 0, 1}; /* ping-pong uses the first two */
+    void* args[NUM_THREADS] = {&sides[0], &sides[1], &sides[2], &sides[3]};
+    uint32_t mhz, us;
+
+    if (0 == (mhz = ece391_tsc_mhz ())) {
+        ece391_fdputs (1, (uint8_t*)"tsc calibration failed\n");
+        return 3;
+    }
+
+    ece391_mutex_init (&mutex);
+    counter = 0;
+    if (0 == (us = run_threads (mutex_worker, args, NUM_THREADS, mhz))) {
+        ece391_fdputs (1, (uint8_t*)"thread start failed\n");
+        return 3;
+    }
+    ece391_print_stat ("futex mutex: ", us / 1000);
+    ece391_print_stat (" ms, count ", counter);
+    ece391_fdputs (1, (uint8_t*)"\n");
+
+    spinlock = 0;
+    counter = 0;
+    if (0 == (us = run_threads (spin_worker, args, NUM_THREADS, mhz))) {
+        ece391_fdputs (1, (uint8_t*)"thread start failed\n");
+        return 3;
+    }
+    ece391_print_stat ("spinlock:    ", us / 1000);
+    ece391_print_stat (" ms, count ", counter);
+    ece391_print_stat (" (expected ", NUM_THREADS * ITERS);
+    ece391_fdputs (1, (uint8_t*)")\n");
+
+    ece391_cond_init (&turn_changed);
+    turn = 0;
+    if (0 == (us = run_threads (pingpong, args, 2, mhz))) {
+        ece391_fdputs (1, (uint8_t*)"thread start failed\n");
+        return 3;
+    }
+    ece391_print_stat ("condvar ping-pong: ", us * 1000 / (2 * PINGPONG_ROUNDS));
+    ece391_fdputs (1, (uint8_t*)" ns per handoff\n");
+    return 0;
+}
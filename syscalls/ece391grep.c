@@ -5,18 +5,49 @@
 
 #define BUFSIZE 1024
 #define SBUFSIZE 33
+#define NULL 0
 
+/* 
+ * Search a file mapped with ece391_mmap.  The mapping is read-only, so
+ * lines are bounded by length and written out with ece391_write instead
+ * of being NUL-terminated in place.
+ */
+void
+do_mapped_file (const char* s, int32_t s_len, const char* fname,
+                const uint8_t* data, int32_t len)
+{
+    int32_t line_start, line_end, check;
+
+    line_start = 0;
+    while (line_start < len) {
+        line_end = line_start;
+        while (line_end < len && '\n' != data[line_end])
+            line_end++;
+        for (check = line_start; check + s_len <= line_end; check++) {
+            if (s[0] == data[check] && 
+                0 == ece391_strncmp (data + check, (uint8_t*)s, s_len)) {
+                ece391_fdputs (1, (uint8_t*)fname);
+                ece391_fdputs (1, (uint8_t*)":");
+                ece391_write (1, data + line_start, line_end - line_start);
+                ece391_fdputs (1, (uint8_t*)"\n");
+                break;
+            }
+        }
+        line_start = line_end + 1;
+    }
+}
+
+/* 
+ * Search whatever can be read from fd through a buffer, line by line.
+ * Matching lines are prefixed with "fname:" unless fname is NULL.
+ */
 int32_t
-do_one_file (const char* s, const char* fname) 
+search_fd (const char* s, const char* fname, int32_t fd)
 {
-    int32_t fd, cnt, last, line_start, line_end, check, s_len;
+    int32_t cnt, last, line_start, line_end, check, s_len;
     uint8_t data[BUFSIZE+1];
 
     s_len = ece391_strlen ((uint8_t*)s);
-    if (-1 == (fd = ece391_open ((uint8_t*)fname))) {
-        ece391_fdputs (1, (uint8_t*)"file open failed\n");
-        return -1;
-    }
     last = 0;
     while (1) {
         cnt = ece391_read (fd, data + last, BUFSIZE - last);
@@ -42,8 +73,10 @@ do_one_file (const char* s, const char* fname)
 	    for (check = line_start; check < line_end; check++) {
 		if (s[0] == data[check] && 
 		    0 == ece391_strncmp ((uint8_t*)(data + check), (uint8_t*)s, s_len)) {
-		    ece391_fdputs (1, (uint8_t*)fname);
-		    ece391_fdputs (1, (uint8_t*)":");
+		    if (NULL != fname) {
+		        ece391_fdputs (1, (uint8_t*)fname);
+		        ece391_fdputs (1, (uint8_t*)":");
+		    }
 		    ece391_fdputs (1, data + line_start);
 		    ece391_fdputs (1, (uint8_t*)"\n");
 		    break;
@@ -58,6 +91,26 @@ do_one_file (const char* s, const char* fname)
 	if (0 == cnt)
 	    break;
     }
+    return 0;
+}
+
+int32_t
+do_one_file (const char* s, const char* fname) 
+{
+    int32_t fd, cnt;
+    uint8_t* mapped;
+
+    if (-1 == (fd = ece391_open ((uint8_t*)fname))) {
+        ece391_fdputs (1, (uint8_t*)"file open failed\n");
+        return -1;
+    }
+    if (-1 != (cnt = ece391_mmap (fd, &mapped))) {
+        do_mapped_file (s, ece391_strlen ((uint8_t*)s), fname, mapped, cnt);
+    }
+    else if (0 != search_fd (s, fname, fd)) {
+        /* not mappable: read through a buffer instead */
+        return -1;
+    }
     if (-1 == ece391_close (fd)) {
         ece391_fdputs (1, (uint8_t*)"file close failed\n");
         return -1;
@@ -76,6 +129,13 @@ int main ()
         return 3;
     }
 
+    /* "grep word -" searches stdin (the output of a pipeline) instead of every file */
+    cnt = ece391_strlen (search);
+    if (cnt >= 2 && 0 == ece391_strcmp (search + cnt - 2, (uint8_t*)" -")) {
+        search[cnt - 2] = '\0';
+        return (0 == search_fd ((char*)search, NULL, 0)) ? 0 : 3;
+    }
+
     if (-1 == (fd = ece391_open ((uint8_t*)"."))) {
         ece391_fdputs (1, (uint8_t*)"directory open failed\n");
 		return 2;
@@ -0,0 +1,106 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define BUFSIZE 4096
+#define TOTAL (1024 * 1024)
+#define NUM_SIZES 6
+#define ARGSIZE 32
+
+static uint8_t buf[BUFSIZE];
+static const int32_t chunk_sizes[NUM_SIZES] = {16, 64, 256, 1024, 2048, 4096};
+
+/* Parse a decimal number, -1 if "s" is not one */
+static int32_t parse_num (const uint8_t* s)
+{
+    int32_t value = 0;
+
+    if ('\0' == *s)
+        return -1;
+    for (; '\0' != *s; s++) {
+        if (*s < '0' || *s > '9')
+            return -1;
+        value = value * 10 + (*s - '0');
+    }
+    return value;
+}
+
+/* Writer side ("pipebench -w size"): push TOTAL bytes to stdout in size chunks */
+static int32_t writer (int32_t size)
+{
+    int32_t done;
+
+    for (done = 0; done < TOTAL; done += size) {
+        if (-1 == ece391_write (1, buf, size))
+            return 3;
+    }
+    return 0;
+}
+
+/*
+ * Spawn a writer feeding TOTAL bytes through a new pipe in size chunks
+ * and drain it with reads of the same size.  Returns the microseconds
+ * from the spawn until the writer is reaped, or 0 on error.
+ */
+static uint32_t run_size (int32_t size, uint32_t mhz)
+{
+    int32_t fds[2], cnt, pid, status, total = 0;
+    uint8_t cmd[ARGSIZE];
+    uint8_t num[16];
+    uint64_t start;
+
+    ece391_strcpy (cmd, (uint8_t*)"pipebench -w ");
+    ece391_strcpy (cmd + ece391_strlen (cmd), ece391_itoa (size, num, 10));
+    if (-1 == ece391_pipe (fds))
+        return 0;
+
+    start = ece391_rdtsc ();
+    if (-1 == (pid = ece391_spawn (cmd, 0, fds[1]))) {
+        ece391_close (fds[0]);
+        ece391_close (fds[1]);
+        return 0;
+    }
+    ece391_close (fds[1]);
+    while (0 < (cnt = ece391_read (fds[0], buf, size)))
+        total += cnt;
+    ece391_close (fds[0]);
+    if (pid != ece391_waitpid (pid, &status, 0) || 0 != status || TOTAL != total)
+        return 0;
+    return ece391_cycles_to_us (ece391_rdtsc () - start, mhz);
+}
+
+int main ()
+{
+    int32_t size, i;
+    uint32_t mhz, us;
+    uint8_t args[ARGSIZE];
+
+    if (0 == ece391_getargs (args, ARGSIZE) && '-' == args[0] && 'w' == args[1]) {
+        if (' ' != args[2] || (size = parse_num (args + 3)) <= 0 || size > BUFSIZE)
+            return 2;
+        return writer (size);
+    }
+
+    if (0 == (mhz = ece391_tsc_mhz ())) {
+        ece391_fdputs (1, (uint8_t*)"tsc calibration failed\n");
+        return 3;
+    }
+
+    for (i = 0; i < NUM_SIZES; i++) {
+        if (0 == (us = run_size (chunk_sizes[i], mhz))) {
+            ece391_fdputs (1, (uint8_t*)"pipe transfer failed\n");
+            return 3;
+        }
+
+        /* bytes per microsecond is MB/s; keep one decimal place */
+        ece391_print_stat ("chunk ", chunk_sizes[i]);
+        ece391_print_stat (": ", (TOTAL * 10 / us) / 10);
+        ece391_print_stat (".", (TOTAL * 10 / us) % 10);
+        ece391_print_stat (" MB/s (", TOTAL);
+        ece391_print_stat (" bytes in ", us);
+        ece391_fdputs (1, (uint8_t*)" us)\n");
+    }
+
+    return 0;
+}
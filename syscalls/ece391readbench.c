@@ -0,0 +1,71 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define BUFSIZE 4096
+#define REPEAT 32
+#define NUM_SIZES 7
+
+static uint8_t buf[BUFSIZE];
+static const int32_t read_sizes[NUM_SIZES] = {1, 16, 64, 256, 1024, 2048, 4096};
+
+/* 
+ * Read the whole file REPEAT times with a fixed read size and return the
+ * number of bytes read in total, or -1 on error.
+ */
+static int32_t read_file (const uint8_t* fname, int32_t size)
+{
+    int32_t fd, cnt, total = 0, i;
+
+    for (i = 0; i < REPEAT; i++) {
+        if (-1 == (fd = ece391_open (fname)))
+            return -1;
+        while (0 != (cnt = ece391_read (fd, buf, size))) {
+            if (-1 == cnt)
+                return -1;
+            total += cnt;
+        }
+        ece391_close (fd);
+    }
+    return total;
+}
+
+int main ()
+{
+    int32_t total, i;
+    uint32_t mhz, us;
+    uint64_t start;
+    uint8_t fname[BUFSIZE];
+
+    if (0 != ece391_getargs (fname, BUFSIZE) || '\0' == fname[0])
+        ece391_strcpy (fname, (uint8_t*)"fish");
+
+    if (0 == (mhz = ece391_tsc_mhz ())) {
+        ece391_fdputs (1, (uint8_t*)"tsc calibration failed\n");
+        return 3;
+    }
+    ece391_print_stat ("tsc MHz: ", mhz);
+    ece391_fdputs (1, (uint8_t*)"\n");
+
+    for (i = 0; i < NUM_SIZES; i++) {
+        start = ece391_rdtsc ();
+        if (-1 == (total = read_file (fname, read_sizes[i]))) {
+            ece391_fdputs (1, (uint8_t*)"file read failed\n");
+            return 3;
+        }
+        us = ece391_cycles_to_us (ece391_rdtsc () - start, mhz);
+        if (0 == us)
+            us = 1;
+
+        /* bytes per microsecond is MB/s; keep one decimal place */
+        ece391_print_stat ("read size ", read_sizes[i]);
+        ece391_print_stat (": ", (total * 10 / us) / 10);
+        ece391_print_stat (".", (total * 10 / us) % 10);
+        ece391_print_stat (" MB/s (", total);
+        ece391_print_stat (" bytes in ", us);
+        ece391_fdputs (1, (uint8_t*)" us)\n");
+    }
+
+    return 0;
+}
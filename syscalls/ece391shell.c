@@ -4,14 +4,106 @@
 #include "ece391syscall.h"
 
 #define BUFSIZE 1024
+#define NULL 0
+#define MAX_STAGES 8
+
+/* Cut leading and trailing spaces off s in place and return the new start */
+static uint8_t* trim (uint8_t* s)
+{
+    uint32_t len;
+
+    while (' ' == *s)
+        s++;
+    for (len = ece391_strlen (s); len > 0 && ' ' == s[len - 1]; len--)
+        s[len - 1] = '\0';
+    return s;
+}
+
+/* 
+ * Run "cmd1 | cmd2 | ...".  Every stage is spawned with its stdout going
+ * into a pipe that is the next stage's stdin, the last stage writes to
+ * the terminal.  In the foreground the shell waits for every stage; in
+ * the background (a trailing '&') it prints the last stage's pid and
+ * comes straight back to the prompt.
+ */
+static void run_pipeline (uint8_t* line, int32_t background)
+{
+    int32_t in = 0, out, fds[2], status;
+    int32_t pids[MAX_STAGES];
+    int32_t num_pids = 0, i;
+    uint8_t* stage;
+    uint8_t* next;
+    uint8_t num[16];
+
+    for (stage = line; NULL != stage; stage = next) {
+        for (next = stage; '\0' != *next && '|' != *next; next++);
+        if ('|' == *next)
+            *next++ = '\0';
+        else
+            next = NULL;
+        stage = trim (stage);
+
+        out = 1;
+        if (NULL != next) {
+            if (-1 == ece391_pipe (fds)) {
+                ece391_fdputs (1, (uint8_t*)"pipe failed\n");
+                break;
+            }
+            out = fds[1];
+        }
+        if (MAX_STAGES == num_pids || '\0' == stage[0] ||
+            -1 == (pids[num_pids] = ece391_spawn (stage, in, out))) {
+            ece391_fdputs (1, (uint8_t*)"no such command: ");
+            ece391_fdputs (1, stage);
+            ece391_fdputs (1, (uint8_t*)"\n");
+        } else {
+            num_pids++;
+        }
+        /* the children hold their own references to the pipe ends now */
+        if (1 != out)
+            ece391_close (out);
+        if (0 != in)
+            ece391_close (in);
+        in = (NULL != next) ? fds[0] : 0;
+    }
+    if (0 != in)
+        ece391_close (in);
+
+    if (background) {
+        if (0 != num_pids) {
+            ece391_fdputs (1, (uint8_t*)"[");
+            ece391_fdputs (1, ece391_itoa (pids[num_pids - 1], num, 10));
+            ece391_fdputs (1, (uint8_t*)"]\n");
+        }
+        return;
+    }
+    for (i = 0; i < num_pids; i++)
+        ece391_waitpid (pids[i], &status, 0);
+}
+
+/* Collect background jobs that have finished and report them */
+static void reap_jobs (void)
+{
+    int32_t pid, status;
+    uint8_t num[16];
+
+    while (0 < (pid = ece391_waitpid (WAIT_ANY, &status, WNOHANG))) {
+        ece391_fdputs (1, (uint8_t*)"[");
+        ece391_fdputs (1, ece391_itoa (pid, num, 10));
+        ece391_fdputs (1, (uint8_t*)"] done, status ");
+        ece391_fdputs (1, ece391_itoa (status, num, 10));
+        ece391_fdputs (1, (uint8_t*)"\n");
+    }
+}
 
 int main ()
 {
-    int32_t cnt, rval;
+    int32_t cnt, rval, background;
     uint8_t buf[BUFSIZE];
     ece391_fdputs (1, (uint8_t*)"Starting 391 Shell\n");
 
     while (1) {
+        reap_jobs ();
         ece391_fdputs (1, (uint8_t*)"391OS> ");
 	if (-1 == (cnt = ece391_read (0, buf, BUFSIZE-1))) {
 	    ece391_fdputs (1, (uint8_t*)"read from keyboard failed\n");
@@ -24,6 +116,18 @@ int main ()
 	    return 0;
 	if ('\0' == buf[0])
 	    continue;
+	background = 0;
+	while (cnt > 0 && ' ' == buf[cnt - 1])
+	    buf[--cnt] = '\0';
+	if (cnt > 0 && '&' == buf[cnt - 1]) {
+	    buf[--cnt] = '\0';
+	    background = 1;
+	}
+	for (rval = 0; '\0' != buf[rval] && '|' != buf[rval]; rval++);
+	if (background || '|' == buf[rval]) {
+	    run_pipeline (buf, background);
+	    continue;
+	}
 	rval = ece391_execute (buf);
 	if (-1 == rval)
 	    ece391_fdputs (1, (uint8_t*)"no such command\n");
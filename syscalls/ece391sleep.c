@@ -0,0 +1,65 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define BUFSIZE 32
+#define DEFAULT_MS 1000
+#define NS_PER_US 1000
+
+/* Parse a decimal number, -1 if "s" is not one */
+static int32_t parse_num (const uint8_t* s)
+{
+    int32_t value = 0;
+
+    if ('\0' == *s)
+        return -1;
+    for (; '\0' != *s; s++) {
+        if (*s < '0' || *s > '9')
+            return -1;
+        value = value * 10 + (*s - '0');
+    }
+    return value;
+}
+
+/* Microseconds on the monotonic clock (wraps after about an hour) */
+static uint32_t now_us (void)
+{
+    struct timespec ts;
+
+    ece391_clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000 + ts.tv_nsec / NS_PER_US;
+}
+
+/*
+ * sleep [ms]: sleep for ms milliseconds (default DEFAULT_MS) and report
+ * how long the sleep really took by the monotonic clock.
+ */
+int main ()
+{
+    uint8_t arg[BUFSIZE];
+    struct timespec req;
+    int32_t ms = DEFAULT_MS;
+    uint32_t start, slept;
+
+    if (0 == ece391_getargs (arg, BUFSIZE) && '\0' != arg[0]) {
+        if (-1 == (ms = parse_num (arg))) {
+            ece391_fdputs (1, (uint8_t*)"usage: sleep [milliseconds]\n");
+            return 3;
+        }
+    }
+
+    req.tv_sec = ms / 1000;
+    req.tv_nsec = (ms % 1000) * 1000000;
+    start = now_us ();
+    if (-1 == ece391_nanosleep (&req, 0)) {
+        ece391_fdputs (1, (uint8_t*)"nanosleep failed\n");
+        return 3;
+    }
+    slept = now_us () - start;
+
+    ece391_print_stat ("asked for ", ms * 1000);
+    ece391_print_stat (" us, slept ", slept);
+    ece391_fdputs (1, (uint8_t*)" us\n");
+    return 0;
+}
@@ -3,6 +3,9 @@
 #include "ece391support.h"
 #include "ece391syscall.h"
 
+/* The kernel info page, mapped read-only into every process */
+#define KINFO ((const struct kinfo*)KINFO_ADDRESS)
+
 uint32_t ece391_strlen(const uint8_t* s)
 {
     uint32_t len;
@@ -102,3 +105,213 @@ uint8_t* ece391_strrev(uint8_t* s)
    return s;
 }
 
+
+/* Write label followed by value in decimal to stdout, with no newline */
+void ece391_print_stat(const char* label, uint32_t value)
+{
+    uint8_t buf[16];
+
+    ece391_fdputs (1, (uint8_t*)label);
+    ece391_fdputs (1, ece391_itoa (value, buf, 10));
+}
+
+/* Read the CPU time stamp counter */
+uint64_t ece391_rdtsc(void)
+{
+    uint32_t lo, hi;
+
+    asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/* 
+ * TSC rate in cycles per microsecond.  The kernel calibrates the TSC at
+ * boot and publishes the rate on the info page, so normally that is all
+ * this reads.  Otherwise the RTC is opened, set to 16 Hz, and eight ticks
+ * (half a second) are timed after syncing to a tick edge.  Returns 0 if
+ * neither works.
+ */
+uint32_t ece391_tsc_mhz(void)
+{
+    int32_t rtc_fd, rate = 16, garbage, i;
+    uint32_t mhz = 0;
+    uint64_t start;
+
+    if (0 != KINFO->tsc_khz)
+        return KINFO->tsc_khz / 1000;
+    if (-1 == (rtc_fd = ece391_open ((uint8_t*)"rtc")))
+        return 0;
+    if (-1 != ece391_write (rtc_fd, &rate, 4)) {
+        ece391_read (rtc_fd, &garbage, 4);
+        start = ece391_rdtsc ();
+        for (i = 0; i < 8; i++)
+            ece391_read (rtc_fd, &garbage, 4);
+        /* cycles per half second / 500000 = cycles per microsecond */
+        mhz = ece391_div64_32 (ece391_rdtsc () - start, 500000);
+    }
+    ece391_close (rtc_fd);
+    return mhz;
+}
+
+/* 
+ * n / d with a single divl, since we don't link against libgcc's 64-bit
+ * division helpers.  Returns 0xFFFFFFFF if d is 0 or the quotient does
+ * not fit in 32 bits.
+ */
+uint32_t ece391_div64_32(uint64_t n, uint32_t d)
+{
+    uint32_t lo = (uint32_t)n, hi = (uint32_t)(n >> 32), q;
+
+    if (0 == d || hi >= d)
+        return 0xFFFFFFFF;
+    asm ("divl %4" : "=a" (q), "=d" (hi) : "a" (lo), "d" (hi), "rm" (d));
+    return q;
+}
+
+/* Convert a cycle count to microseconds at mhz cycles per microsecond */
+uint32_t ece391_cycles_to_us(uint64_t cycles, uint32_t mhz)
+{
+    return ece391_div64_32 (cycles, mhz);
+}
+
+/* Timer ticks (10 ms) since boot, as of the last interrupt or task switch */
+uint32_t ece391_ticks(void)
+{
+    return KINFO->ticks;
+}
+
+/* 
+ * Nanoseconds since boot from the TSC, scaled as the kernel describes on
+ * the info page.  A timer tick may move the base while it is being read,
+ * in which case seq changes and the read is repeated.
+ */
+uint64_t ece391_clock_ns(void)
+{
+    uint32_t seq;
+    uint64_t ns;
+
+    do {
+        seq = KINFO->seq;
+        asm volatile ("" : : : "memory");
+        ns = KINFO->ns_base;
+        if (0 != KINFO->tsc_mult)
+            ns += ((ece391_rdtsc () - KINFO->tsc_base) * KINFO->tsc_mult
+                   + KINFO->tsc_frac) >> KINFO_TSC_SHIFT;
+        asm volatile ("" : : : "memory");
+    } while ((seq & 1) || seq != KINFO->seq);
+    return ns;
+}
+
+/* The caller's process id */
+int32_t ece391_getpid(void)
+{
+    return KINFO->pid;
+}
+
+/* The terminal (its root shell's pid) the caller runs in */
+int32_t ece391_terminal(void)
+{
+    return KINFO->terminal;
+}
+
+/* The terminal currently on screen */
+int32_t ece391_screen(void)
+{
+    return KINFO->screen;
+}
+
+/* first code of a thread, in ece391syscall.S */
+extern void ece391_thread_entry(void);
+
+/* 
+ * Start fn(arg) in a new thread of this process, running on the stack
+ * [stack, stack + size).  The thread halts with fn's return value.
+ * Returns the thread's pid (collect it with ece391_waitpid) or -1.
+ */
+int32_t ece391_thread_start(int32_t (*fn)(void*), void* arg, uint8_t* stack, uint32_t size)
+{
+    uint32_t* top = (uint32_t*)(((uint32_t)stack + size) & ~0xF);
+
+    *--top = (uint32_t)arg;
+    *--top = (uint32_t)fn;
+    return ece391_thread_create (ece391_thread_entry, top);
+}
+
+/* Atomically store value in *word and return what was there */
+static uint32_t xchg (volatile uint32_t* word, uint32_t value)
+{
+    asm volatile ("xchgl %0, %1" : "+r" (value), "+m" (*word) : : "memory");
+    return value;
+}
+
+/* Atomically store value in *word if it holds expected, return what was there */
+static uint32_t cmpxchg (volatile uint32_t* word, uint32_t expected, uint32_t value)
+{
+    asm volatile ("lock; cmpxchgl %2, %1"
+                  : "+a" (expected), "+m" (*word) : "r" (value) : "memory", "cc");
+    return expected;
+}
+
+void ece391_mutex_init(struct ece391_mutex* m)
+{
+    m->state = 0;
+}
+
+/* 
+ * Take the lock: one atomic instruction when it is free.  Otherwise mark
+ * it contended (2) and sleep in the kernel until the holder wakes us,
+ * then try again, leaving it marked since others may still be asleep.
+ */
+void ece391_mutex_lock(struct ece391_mutex* m)
+{
+    uint32_t c;
+
+    if (0 == (c = cmpxchg (&m->state, 0, 1)))
+        return;
+    if (2 != c)
+        c = xchg (&m->state, 2);
+    while (0 != c) {
+        ece391_futex (&m->state, FUTEX_WAIT, 2);
+        c = xchg (&m->state, 2);
+    }
+}
+
+/* Release the lock, entering the kernel only if someone may be asleep on it */
+void ece391_mutex_unlock(struct ece391_mutex* m)
+{
+    if (2 == xchg (&m->state, 0))
+        ece391_futex (&m->state, FUTEX_WAKE, 1);
+}
+
+void ece391_cond_init(struct ece391_cond* c)
+{
+    c->seq = 0;
+}
+
+/* 
+ * Release m, sleep until a signal, then take m again.  A signal between
+ * the unlock and the sleep changes seq, so the sleep returns at once
+ * instead of missing it.  Callers recheck their condition in a loop.
+ */
+void ece391_cond_wait(struct ece391_cond* c, struct ece391_mutex* m)
+{
+    uint32_t seq = c->seq;
+
+    ece391_mutex_unlock (m);
+    ece391_futex (&c->seq, FUTEX_WAIT, seq);
+    ece391_mutex_lock (m);
+}
+
+/* Wake one waiter */
+void ece391_cond_signal(struct ece391_cond* c)
+{
+    asm volatile ("lock; incl %0" : "+m" (c->seq) : : "memory", "cc");
+    ece391_futex (&c->seq, FUTEX_WAKE, 1);
+}
+
+/* Wake every waiter */
+void ece391_cond_broadcast(struct ece391_cond* c)
+{
+    asm volatile ("lock; incl %0" : "+m" (c->seq) : : "memory", "cc");
+    ece391_futex (&c->seq, FUTEX_WAKE, 0x7FFFFFFF);
+}
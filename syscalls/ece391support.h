@@ -9,5 +9,37 @@ extern int32_t ece391_strncmp(const uint8_t* s1, const uint8_t* s2, uint32_t n);
 extern uint8_t *ece391_itoa(uint32_t value, uint8_t* buf, int32_t radix);
 extern uint8_t *ece391_strrev(uint8_t* s);
 
+/* Benchmark helpers: raw cycle counter and its conversion to wall time */
+extern void ece391_print_stat(const char* label, uint32_t value);
+extern uint64_t ece391_rdtsc(void);
+extern uint32_t ece391_tsc_mhz(void);
+extern uint32_t ece391_cycles_to_us(uint64_t cycles, uint32_t mhz);
+extern uint32_t ece391_div64_32(uint64_t n, uint32_t d);
+
+/* Readers of the kernel info page (no system call) */
+extern uint32_t ece391_ticks(void);
+extern uint64_t ece391_clock_ns(void);
+extern int32_t ece391_getpid(void);
+extern int32_t ece391_terminal(void);
+extern int32_t ece391_screen(void);
+
+/* Run fn(arg) in a new thread on the stack [stack, stack + size), returns its pid */
+extern int32_t ece391_thread_start(int32_t (*fn)(void*), void* arg, uint8_t* stack, uint32_t size);
+
+/* Locks for threads, sleeping in the kernel (futex) only when contended */
+struct ece391_mutex {
+    volatile uint32_t state; /* 0 free, 1 held, 2 held with sleepers */
+};
+struct ece391_cond {
+    volatile uint32_t seq; /* bumped by every signal */
+};
+extern void ece391_mutex_init(struct ece391_mutex* m);
+extern void ece391_mutex_lock(struct ece391_mutex* m);
+extern void ece391_mutex_unlock(struct ece391_mutex* m);
+extern void ece391_cond_init(struct ece391_cond* c);
+extern void ece391_cond_wait(struct ece391_cond* c, struct ece391_mutex* m);
+extern void ece391_cond_signal(struct ece391_cond* c);
+extern void ece391_cond_broadcast(struct ece391_cond* c);
+
 #endif /* ECE391SUPPORT_H */
 
@@ -0,0 +1,67 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define ROUNDS 100000
+#define TRIALS 5
+
+/*
+ * Time ROUNDS back-to-back calls of "call" and return the cycles per
+ * call, best of TRIALS runs so a timer interrupt in one run doesn't skew
+ * the result.  Syscall 0 is rejected as soon as the kernel is entered,
+ * so this is the cost of getting into the kernel and back out.
+ */
+static uint32_t time_path (int32_t (*call)(void))
+{
+    uint32_t best = 0xFFFFFFFF, cycles;
+    uint64_t start;
+    int32_t i, trial;
+
+    for (trial = 0; trial < TRIALS; trial++) {
+        start = ece391_rdtsc ();
+        for (i = 0; i < ROUNDS; i++)
+            call ();
+        cycles = ece391_div64_32 (ece391_rdtsc () - start, ROUNDS);
+        if (cycles < best)
+            best = cycles;
+    }
+    return best;
+}
+
+/* One read of the info page clock, shaped like the calls above */
+static int32_t read_clock (void)
+{
+    return (int32_t)ece391_clock_ns ();
+}
+
+int main ()
+{
+    uint32_t int80, fast;
+
+    if (-1 != ece391_zero_int80 ()) {
+        ece391_fdputs (1, (uint8_t*)"syscall 0 did not fail\n");
+        return 3;
+    }
+    int80 = time_path (ece391_zero_int80);
+    ece391_print_stat ("int $0x80: ", int80);
+    ece391_fdputs (1, (uint8_t*)" cycles per call\n");
+
+    ece391_print_stat ("info page clock: ", time_path (read_clock));
+    ece391_fdputs (1, (uint8_t*)" cycles per read\n");
+
+    if (!ece391_sysenter) {
+        ece391_fdputs (1, (uint8_t*)"sysenter: not enabled by the kernel\n");
+        return 0;
+    }
+    fast = time_path (ece391_zero_sysenter);
+    ece391_print_stat ("sysenter:  ", fast);
+    ece391_fdputs (1, (uint8_t*)" cycles per call\n");
+    if (0 != fast) {
+        ece391_print_stat ("speedup:   ", int80 / fast);
+        ece391_print_stat (".", (int80 * 10 / fast) % 10);
+        ece391_fdputs (1, (uint8_t*)"x\n");
+    }
+
+    return 0;
+}
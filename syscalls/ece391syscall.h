@@ -21,6 +21,130 @@ extern int32_t ece391_getargs (uint8_t* buf, int32_t nbytes);
 extern int32_t ece391_vidmap (uint8_t** screen_start);
 extern int32_t ece391_set_handler (int32_t signum, void* handler);
 extern int32_t ece391_sigreturn (void);
+extern int32_t ece391_mmap (int32_t fd, uint8_t** start);
+/* pid STATS_SYSTEM fills a struct sys_stat, any other pid a struct proc_stat */
+extern int32_t ece391_stats (int32_t pid, void* buf);
+struct timespec;
+/* clock_id must be CLOCK_MONOTONIC (time since boot) */
+extern int32_t ece391_clock_gettime (int32_t clock_id, struct timespec* ts);
+/* rem may be 0, a sleep is never cut short so it is always set to 0 */
+extern int32_t ece391_nanosleep (const struct timespec* req, struct timespec* rem);
+/* fds[0] gets the read end and fds[1] the write end of a new pipe */
+extern int32_t ece391_pipe (int32_t* fds);
+/* 
+ * Start command next to the caller and return its pid right away.  The
+ * child's stdin and stdout are the caller's descriptors stdin_fd and
+ * stdout_fd (terminal or pipe ends).  Once it halts the child stays a
+ * zombie until the caller collects it with waitpid.
+ */
+extern int32_t ece391_spawn (const uint8_t* command, int32_t stdin_fd, int32_t stdout_fd);
+/* 
+ * Collect a halted spawned child (pid, or WAIT_ANY for any of them) and
+ * return its pid, storing its halt status in status unless that is 0.
+ * Blocks until one halts, or returns 0 at once with WNOHANG.
+ */
+extern int32_t ece391_waitpid (int32_t pid, int32_t* status, int32_t options);
+/* 
+ * Start a copy of the caller that carries on from here; returns the
+ * child's pid in the caller and 0 in the child.  Pages are shared until
+ * one side writes them.  Collect the child with waitpid.
+ */
+extern int32_t ece391_fork (void);
+/* 
+ * Start a thread of the calling process at entry with its stack pointer
+ * at stack.  It shares memory and descriptors with the caller; collect
+ * it with waitpid.  When the thread that started the program halts, the
+ * whole process ends and the other threads halt with its status.  See
+ * ece391_thread_start for calling a function in a thread.
+ */
+extern int32_t ece391_thread_create (void (*entry)(void), void* stack);
+/* 
+ * FUTEX_WAIT: sleep until a FUTEX_WAKE on addr, unless *addr != val
+ * (then -1 at once).  FUTEX_WAKE: wake up to val sleepers on addr and
+ * return how many woke.  addr is an aligned word in program memory.
+ */
+extern int32_t ece391_futex (volatile uint32_t* addr, int32_t op, uint32_t val);
+
+/* 1 if the wrappers above use SYSENTER, 0 if they use INT $0x80 */
+extern int32_t ece391_sysenter;
+/* syscall 0 (always fails) through one path, for timing system call entry */
+extern int32_t ece391_zero_int80 (void);
+extern int32_t ece391_zero_sysenter (void);
+
+#define STATS_SYSTEM -1
+#define STATS_NAME_LEN 32
+
+/* task states in proc_stat.state */
+#define TASK_RUNNABLE 1
+#define TASK_BLOCKED  2
+#define TASK_ZOMBIE   3
+
+/* scheduling policies in sys_stat.policy */
+#define SCHED_POLICY_RR   0
+#define SCHED_POLICY_MLFQ 1
+
+/* cpu accounting of one process, times in 10 ms ticks */
+struct proc_stat {
+	int32_t pid;
+	int32_t parent;
+	int32_t terminal;
+	uint32_t state;
+	uint32_t level;
+	uint32_t user_ticks;
+	uint32_t kernel_ticks;
+	uint32_t nvcsw;
+	uint32_t nivcsw;
+	uint32_t syscalls;
+	uint8_t name[STATS_NAME_LEN + 1];
+};
+
+/* whole-system counters, times in 10 ms ticks */
+struct sys_stat {
+	uint32_t ticks;
+	uint32_t idle_ticks;
+	uint32_t timer_interrupts;
+	uint32_t policy;
+	uint32_t frames_free;
+	uint32_t frames_total;
+};
+
+#define CLOCK_MONOTONIC 1
+#define NS_PER_SEC 1000000000
+
+#define WAIT_ANY -1
+#define WNOHANG 1
+
+#define FUTEX_WAIT 0
+#define FUTEX_WAKE 1
+
+struct timespec {
+	uint32_t tv_sec;
+	uint32_t tv_nsec;
+};
+
+/* 
+ * Read-only page the kernel maps into every process and keeps up to
+ * date, so these can be read without a system call (see the helpers in
+ * ece391support.c).  The clock is
+ *     ns = ns_base + (((tsc - tsc_base) * tsc_mult + tsc_frac) >> KINFO_TSC_SHIFT)
+ * and seq is odd while the kernel changes ticks or the clock base.
+ */
+#define KINFO_ADDRESS   0x08401000
+#define KINFO_TSC_SHIFT 24
+
+struct kinfo {
+	volatile uint32_t seq;
+	volatile uint32_t ticks;     /* 10 ms ticks since boot */
+	volatile uint32_t pid;       /* the reading process */
+	volatile uint32_t terminal;  /* its terminal */
+	volatile uint32_t screen;    /* terminal on screen */
+	uint32_t tsc_khz;            /* 0 if the clock only has tick resolution */
+	uint32_t tsc_mult;
+	volatile uint32_t tsc_frac;
+	volatile uint64_t tsc_base;
+	volatile uint64_t ns_base;
+	uint32_t sysenter;           /* 1 if the kernel accepts SYSENTER */
+};
 
 enum signums {
 	DIV_ZERO = 0,
@@ -1,6 +1,7 @@
 #if !defined(ECE391SYSNUM_H)
 #define ECE391SYSNUM_H
 
+#define SYS_ZERO    0
 #define SYS_HALT    1
 #define SYS_EXECUTE 2
 #define SYS_READ    3
@@ -11,5 +12,15 @@
 #define SYS_VIDMAP  8
 #define SYS_SET_HANDLER  9
 #define SYS_SIGRETURN  10
+#define SYS_MMAP    11
+#define SYS_STATS   12
+#define SYS_CLOCK_GETTIME 13
+#define SYS_NANOSLEEP 14
+#define SYS_PIPE    15
+#define SYS_SPAWN   16
+#define SYS_WAITPID 17
+#define SYS_FORK    18
+#define SYS_THREAD_CREATE 19
+#define SYS_FUTEX   20
 
 #endif /* ECE391SYSNUM_H */
@@ -0,0 +1,121 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define ROUNDS 50
+#define STACK_SIZE 8192
+#define RTC_RATE 16
+#define RTC_READS 16
+#define SCANS 200
+#define BUFSIZE 1024
+
+static uint8_t stack[STACK_SIZE];
+static uint8_t buf[BUFSIZE];
+
+/* Thread of the creation rounds: nothing to do */
+static int32_t empty (void* arg)
+{
+    return 0;
+}
+
+/* The paced part of the work: RTC_READS ticks of the rtc open on *arg */
+static int32_t wait_ticks (void* arg)
+{
+    int32_t rtc_fd = *(int32_t*)arg, garbage, i;
+
+    for (i = 0; i < RTC_READS; i++)
+        ece391_read (rtc_fd, &garbage, 4);
+    return 0;
+}
+
+/* The I/O part of the work: read frame0.txt through SCANS times */
+static int32_t scan_file (void)
+{
+    int32_t fd, i;
+
+    for (i = 0; i < SCANS; i++) {
+        if (-1 == (fd = ece391_open ((uint8_t*)"frame0.txt")))
+            return -1;
+        while (0 < ece391_read (fd, buf, BUFSIZE));
+        ece391_close (fd);
+    }
+    return 0;
+}
+
+/*
+ * Time ROUNDS runs of starting a child that does nothing and reaping it,
+ * as a thread (threads != 0) or as a forked process, and return the
+ * microseconds per run (0 on error).
+ */
+static uint32_t time_start (int32_t threads, uint32_t mhz)
+{
+    int32_t i, pid, status;
+    uint64_t start;
+
+    start = ece391_rdtsc ();
+    for (i = 0; i < ROUNDS; i++) {
+        if (threads)
+            pid = ece391_thread_start (empty, 0, stack, STACK_SIZE);
+        else if (0 == (pid = ece391_fork ()))
+            ece391_halt (0);
+        if (-1 == pid || pid != ece391_waitpid (pid, &status, 0) || 0 != status)
+            return 0;
+    }
+    return ece391_cycles_to_us (ece391_rdtsc () - start, mhz) / ROUNDS;
+}
+
+/*
+ * threadbench: the cost of starting a thread next to forking, then an
+ * rtc-paced loop (like fish drawing frames) and file reads done one after
+ * the other and overlapped in two threads of one process.
+ */
+int main ()
+{
+    int32_t rtc_fd, rate = RTC_RATE, pid, status;
+    uint32_t mhz, us;
+    uint64_t start;
+
+    if (0 == (mhz = ece391_tsc_mhz ())) {
+        ece391_fdputs (1, (uint8_t*)"tsc calibration failed\n");
+        return 3;
+    }
+
+    if (0 == (us = time_start (1, mhz))) {
+        ece391_fdputs (1, (uint8_t*)"thread start failed\n");
+        return 3;
+    }
+    ece391_print_stat ("thread start + wait: ", us);
+    if (0 == (us = time_start (0, mhz))) {
+        ece391_fdputs (1, (uint8_t*)"fork failed\n");
+        return 3;
+    }
+    ece391_print_stat (" us, fork + wait: ", us);
+    ece391_fdputs (1, (uint8_t*)" us\n");
+
+    if (-1 == (rtc_fd = ece391_open ((uint8_t*)"rtc"))) {
+        ece391_fdputs (1, (uint8_t*)"rtc open failed\n");
+        return 2;
+    }
+    ece391_write (rtc_fd, &rate, 4);
+    start = ece391_rdtsc ();
+    wait_ticks (&rtc_fd);
+    if (-1 == scan_file ()) {
+        ece391_fdputs (1, (uint8_t*)"frame0.txt open failed\n");
+        return 3;
+    }
+    ece391_print_stat ("rtc ticks then file reads: ", ece391_cycles_to_us (ece391_rdtsc () - start, mhz) / 1000);
+
+    start = ece391_rdtsc ();
+    if (-1 == (pid = ece391_thread_start (wait_ticks, &rtc_fd, stack, STACK_SIZE))) {
+        ece391_fdputs (1, (uint8_t*)"\nthread start failed\n");
+        return 3;
+    }
+    scan_file ();
+    ece391_waitpid (pid, &status, 0);
+    ece391_print_stat (" ms, overlapped in two threads: ", ece391_cycles_to_us (ece391_rdtsc () - start, mhz) / 1000);
+    ece391_fdputs (1, (uint8_t*)" ms\n");
+
+    ece391_close (rtc_fd);
+    return 0;
+}
@@ -0,0 +1,145 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define NUM_COLS 80
+#define NUM_ROWS 25
+#define ATTRIB 0x7
+#define MAX_PIDS 32
+#define REFRESH_HZ 2
+#define DEFAULT_REFRESHES 20
+#define BUFSIZE 32
+
+static uint8_t* screen;
+static uint32_t last_ticks;
+static uint32_t last_idle;
+static uint32_t last_cpu[MAX_PIDS];
+
+/* Write "s" into row "row" starting at column "col", clipped to the screen */
+static void put_str (int32_t row, int32_t col, const uint8_t* s)
+{
+    for (; *s != '\0' && col < NUM_COLS; s++, col++) {
+        screen[(row * NUM_COLS + col) << 1] = *s;
+        screen[((row * NUM_COLS + col) << 1) + 1] = ATTRIB;
+    }
+}
+
+/* Write "value" right aligned so that it ends just before column "end" */
+static void put_num (int32_t row, int32_t end, uint32_t value)
+{
+    uint8_t num[BUFSIZE];
+
+    ece391_itoa (value, num, 10);
+    put_str (row, end - (int32_t)ece391_strlen (num), num);
+}
+
+/* Blank row "row" */
+static void clear_row (int32_t row)
+{
+    int32_t col;
+
+    for (col = 0; col < NUM_COLS; col++) {
+        screen[(row * NUM_COLS + col) << 1] = ' ';
+        screen[((row * NUM_COLS + col) << 1) + 1] = ATTRIB;
+    }
+}
+
+/* Draw one frame: system summary, then a line per process with its share of the last interval */
+static void draw (void)
+{
+    struct sys_stat sys;
+    struct proc_stat ps;
+    uint32_t interval, busy, cpu;
+    int32_t pid, row;
+
+    if (0 != ece391_stats (STATS_SYSTEM, &sys))
+        return;
+    interval = sys.ticks - last_ticks;
+    busy = interval - (sys.idle_ticks - last_idle);
+    if (0 == interval)
+        interval = 1;
+
+    clear_row (0);
+    put_str (0, 0, (uint8_t*)"top -");
+    put_num (0, 16, sys.ticks);
+    put_str (0, 17, (uint8_t*)"ticks, cpu");
+    put_num (0, 31, busy * 100 / interval);
+    put_str (0, 31, (uint8_t*)"% busy,");
+    put_num (0, 49, sys.timer_interrupts);
+    put_str (0, 50, (uint8_t*)"timer irqs,");
+    put_str (0, 62, SCHED_POLICY_MLFQ == sys.policy ? (uint8_t*)"mlfq" : (uint8_t*)"round robin");
+    clear_row (1);
+    put_str (1, 0, (uint8_t*)"frames free");
+    put_num (1, 20, sys.frames_free);
+    put_str (1, 21, (uint8_t*)"of");
+    put_num (1, 32, sys.frames_total);
+    clear_row (2);
+    clear_row (3);
+    put_str (3, 0, (uint8_t*)"PID PPID TTY S LVL CPU%   USER KERNEL   VCSW  IVCSW SYSCALLS NAME");
+
+    row = 4;
+    for (pid = 0; pid < MAX_PIDS && row < NUM_ROWS; pid++) {
+        if (0 != ece391_stats (pid, &ps)) {
+            last_cpu[pid] = 0;
+            continue;
+        }
+        cpu = ps.user_ticks + ps.kernel_ticks;
+        clear_row (row);
+        put_num (row, 3, ps.pid);
+        if (ps.parent >= 0)
+            put_num (row, 8, ps.parent);
+        else
+            put_str (row, 7, (uint8_t*)"-");
+        put_num (row, 12, ps.terminal + 1);
+        put_str (row, 13, TASK_RUNNABLE == ps.state ? (uint8_t*)"R" :
+                          TASK_BLOCKED == ps.state ? (uint8_t*)"S" : (uint8_t*)"Z");
+        put_num (row, 18, ps.level);
+        put_num (row, 23, (cpu - last_cpu[pid]) * 100 / interval);
+        put_num (row, 30, ps.user_ticks);
+        put_num (row, 37, ps.kernel_ticks);
+        put_num (row, 44, ps.nvcsw);
+        put_num (row, 51, ps.nivcsw);
+        put_num (row, 60, ps.syscalls);
+        put_str (row, 61, ps.name);
+        last_cpu[pid] = cpu;
+        row++;
+    }
+    for (; row < NUM_ROWS; row++)
+        clear_row (row);
+
+    last_ticks = sys.ticks;
+    last_idle = sys.idle_ticks;
+}
+
+int main ()
+{
+    int32_t rtc_fd, rate, garbage, refreshes, i;
+    uint8_t buf[BUFSIZE];
+
+    refreshes = DEFAULT_REFRESHES;
+    if (0 == ece391_getargs (buf, BUFSIZE) && '\0' != buf[0]) {
+        refreshes = 0;
+        for (i = 0; buf[i] >= '0' && buf[i] <= '9'; i++)
+            refreshes = refreshes * 10 + buf[i] - '0';
+    }
+
+    if (-1 == ece391_vidmap (&screen)) {
+        ece391_fdputs (1, (uint8_t*)"vidmap failed\n");
+        return 2;
+    }
+    if (-1 == (rtc_fd = ece391_open ((uint8_t*)"rtc"))) {
+        ece391_fdputs (1, (uint8_t*)"rtc open failed\n");
+        return 3;
+    }
+    rate = REFRESH_HZ;
+    ece391_write (rtc_fd, &rate, 4);
+
+    draw ();
+    for (i = 0; i < refreshes; i++) {
+        ece391_read (rtc_fd, &garbage, 4);
+        draw ();
+    }
+    ece391_close (rtc_fd);
+    return 0;
+}